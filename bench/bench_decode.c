@@ -0,0 +1,198 @@
+/* Decode throughput of qoi_decode_pixels() against the previous decoder, a
+ single if/else chain with bounds checks on every chunk (kept below as
+ ref_decode_pixels()). Throughput is given in MB of decoded pixels per second.
+
+ Build and run from the package root:
+
+   cc -O2 -Isrc bench/bench_decode.c src/decode.c src/encode.c src/scan.c -lm \
+     -o bench_decode
+   ./bench_decode [file.qoi ...]
+
+ Without arguments the images in inst/extdata are used; a synthetic corpus
+ (see bench_images.h) is always added. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qoi.h"
+#include "bench_images.h"
+
+static int ref_decode_pixels(const void *data, int size, const qoi_desc *desc,
+                             int channels, unsigned char *pixels) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  qoi_rgba_t index[64];
+  qoi_rgba_t px;
+  int px_len, chunks_len, px_pos;
+  int p = QOI_HEADER_SIZE, run = 0;
+
+  px_len = desc->width * desc->height * channels;
+  QOI_ZEROARR(index);
+  px.rgba.r = 0;
+  px.rgba.g = 0;
+  px.rgba.b = 0;
+  px.rgba.a = 255;
+
+  chunks_len = size - (int)sizeof(qoi_padding);
+  for (px_pos = 0; px_pos < px_len; px_pos += channels) {
+    if (run > 0) {
+      run--;
+    }
+    else if (p < chunks_len) {
+      int b1 = bytes[p++];
+
+      if (b1 == QOI_OP_RGB) {
+        if (p + 3 > chunks_len) break;
+        px.rgba.r = bytes[p++];
+        px.rgba.g = bytes[p++];
+        px.rgba.b = bytes[p++];
+      }
+      else if (b1 == QOI_OP_RGBA) {
+        if (p + 4 > chunks_len) break;
+        px.rgba.r = bytes[p++];
+        px.rgba.g = bytes[p++];
+        px.rgba.b = bytes[p++];
+        px.rgba.a = bytes[p++];
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+        px = index[b1];
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+        px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+        px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+        px.rgba.b += ( b1       & 0x03) - 2;
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+        if (p + 1 > chunks_len) break;
+        int b2 = bytes[p++];
+        int vg = (b1 & 0x3f) - 32;
+        px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+        px.rgba.g += vg;
+        px.rgba.b += vg - 8 +  (b2       & 0x0f);
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_RUN) {
+        run = (b1 & 0x3f);
+      }
+
+      index[QOI_COLOR_HASH(px) % 64] = px;
+    }
+
+    pixels[px_pos + 0] = px.rgba.r;
+    pixels[px_pos + 1] = px.rgba.g;
+    pixels[px_pos + 2] = px.rgba.b;
+
+    if (channels == 4) {
+      pixels[px_pos + 3] = px.rgba.a;
+    }
+  }
+
+  return px_pos >= px_len;
+}
+
+/* best of several rounds, in MB/s; the decoders take turns in every round so
+ both see the same machine load */
+static void bench_decoders(const unsigned char *data, size_t size, const qoi_desc *desc,
+                           unsigned char *out, double *ref, double *fast) {
+  size_t bytes = (size_t) desc->width * desc->height * desc->channels;
+  int reps = (int) (100e6 / bytes) + 1;
+  double best[2] = {1e30, 1e30};
+
+  for (int round = 0; round < 9; round++) {
+    for (int k = 0; k < 2; k++) {
+      double t0 = bench_now();
+      for (int r = 0; r < reps; r++) {
+        if (k == 0)
+          ref_decode_pixels(data, size, desc, desc->channels, out);
+        else
+          qoi_decode_pixels(data, size, desc, desc->channels, out);
+      }
+      double t = (bench_now() - t0) / reps;
+      if (t < best[k]) best[k] = t;
+    }
+  }
+  *ref = bytes / best[0] / 1e6;
+  *fast = bytes / best[1] / 1e6;
+}
+
+static void bench_one(const char *name, const unsigned char *data, size_t size) {
+  qoi_desc desc;
+  unsigned char *a, *b;
+
+  if (!qoi_decode_header(data, size, &desc)) {
+    fprintf(stderr, "%s: not a QOI image\n", name);
+    return;
+  }
+  a = malloc((size_t) desc.width * desc.height * desc.channels);
+  b = malloc((size_t) desc.width * desc.height * desc.channels);
+
+  ref_decode_pixels(data, size, &desc, desc.channels, a);
+  qoi_decode_pixels(data, size, &desc, desc.channels, b);
+  if (memcmp(a, b, (size_t) desc.width * desc.height * desc.channels) != 0)
+    printf("%s: MISMATCH\n", name);
+
+  double ref, fast;
+  bench_decoders(data, size, &desc, a, &ref, &fast);
+  printf("%-28s %5ux%-5u %d  %8.1f  %8.1f  %5.2fx\n", name, desc.width,
+         desc.height, desc.channels, ref, fast, fast / ref);
+  free(a);
+  free(b);
+}
+
+static unsigned char *read_file(const char *fn, size_t *size) {
+  FILE *f = fopen(fn, "rb");
+  unsigned char *data;
+
+  if (!f) return NULL;
+  fseek(f, 0, SEEK_END);
+  *size = (size_t) ftell(f);
+  rewind(f);
+  data = malloc(*size);
+  if (fread(data, 1, *size, f) != *size) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  return data;
+}
+
+int main(int argc, char **argv) {
+  static const char *bundled[] = {
+    "inst/extdata/Rlogo.qoi", "inst/extdata/qoi_logo.qoi",
+    "inst/extdata/testcard_rgba.qoi"
+  };
+  static const struct {
+    const char *name;
+    void (*fill)(unsigned char *, int, int, int);
+  } kinds[] = {{"photo", bench_photo}, {"ui", bench_ui}, {"noise", bench_noise}};
+  const char **files = argc > 1 ? (const char **) argv + 1 : bundled;
+  int n_files = argc > 1 ? argc - 1 : 3;
+
+  printf("%-28s %11s %s  %8s  %8s  %6s\n", "image", "size", "c",
+         "ref MB/s", "new MB/s", "speedup");
+
+  for (int i = 0; i < n_files; i++) {
+    size_t size;
+    unsigned char *data = read_file(files[i], &size);
+    if (!data) {
+      fprintf(stderr, "%s: unable to read\n", files[i]);
+      continue;
+    }
+    bench_one(files[i], data, size);
+    free(data);
+  }
+
+  for (int k = 0; k < 3; k++) {
+    for (int channels = 3; channels <= 4; channels++) {
+      qoi_desc desc = {2000, 2000, channels, QOI_SRGB};
+      unsigned char *px = malloc((size_t) desc.width * desc.height * channels);
+      char name[32];
+      size_t size;
+
+      kinds[k].fill(px, desc.width, desc.height, channels);
+      unsigned char *data = qoi_encode(px, &desc, &size);
+      snprintf(name, sizeof(name), "synthetic %s", kinds[k].name);
+      bench_one(name, data, size);
+      free(data);
+      free(px);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,225 @@
+/* Encode throughput of qoi_encode_pixels() against the previous encoder, which
+ classified every pixel on its own (kept below as ref_encode_pixels()).
+ Throughput is given in MB of input pixels per second, the output of both has
+ to be identical.
+
+ Build and run from the package root:
+
+   cc -O2 -Isrc bench/bench_encode.c src/encode.c src/decode.c src/scan.c -lm \
+     -o bench_encode
+   ./bench_encode [file.qoi ...]
+
+ Without arguments the images in inst/extdata are used; a synthetic corpus
+ (see bench_images.h) is always added. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qoi.h"
+#include "scan.h"
+#include "bench_images.h"
+
+static int ref_encode_pixels(const unsigned char *pixels, int n_pixels,
+                             int channels, unsigned char *bytes) {
+  qoi_rgba_t index[64];
+  qoi_rgba_t px, px_prev;
+  int p = 0, run = 0, px_len, px_pos;
+
+  QOI_ZEROARR(index);
+  px_prev.rgba.r = 0;
+  px_prev.rgba.g = 0;
+  px_prev.rgba.b = 0;
+  px_prev.rgba.a = 255;
+  px = px_prev;
+  px_len = n_pixels * channels;
+
+  for (px_pos = 0; px_pos < px_len; px_pos += channels) {
+    px.rgba.r = pixels[px_pos + 0];
+    px.rgba.g = pixels[px_pos + 1];
+    px.rgba.b = pixels[px_pos + 2];
+    if (channels == 4) {
+      px.rgba.a = pixels[px_pos + 3];
+    }
+
+    if (px.v == px_prev.v) {
+      run++;
+      if (run == 62) {
+        bytes[p++] = QOI_OP_RUN | (run - 1);
+        run = 0;
+      }
+    }
+    else {
+      int index_pos;
+
+      if (run > 0) {
+        bytes[p++] = QOI_OP_RUN | (run - 1);
+        run = 0;
+      }
+
+      index_pos = QOI_COLOR_HASH(px) % 64;
+
+      if (index[index_pos].v == px.v) {
+        bytes[p++] = QOI_OP_INDEX | index_pos;
+      }
+      else {
+        index[index_pos] = px;
+
+        if (px.rgba.a == px_prev.rgba.a) {
+          signed char vr = px.rgba.r - px_prev.rgba.r;
+          signed char vg = px.rgba.g - px_prev.rgba.g;
+          signed char vb = px.rgba.b - px_prev.rgba.b;
+          signed char vg_r = vr - vg;
+          signed char vg_b = vb - vg;
+
+          if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+            bytes[p++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+          }
+          else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+                   vg_b > -9 && vg_b < 8) {
+            bytes[p++] = QOI_OP_LUMA | (vg + 32);
+            bytes[p++] = (vg_r + 8) << 4 | (vg_b + 8);
+          }
+          else {
+            bytes[p++] = QOI_OP_RGB;
+            bytes[p++] = px.rgba.r;
+            bytes[p++] = px.rgba.g;
+            bytes[p++] = px.rgba.b;
+          }
+        }
+        else {
+          bytes[p++] = QOI_OP_RGBA;
+          bytes[p++] = px.rgba.r;
+          bytes[p++] = px.rgba.g;
+          bytes[p++] = px.rgba.b;
+          bytes[p++] = px.rgba.a;
+        }
+      }
+    }
+    px_prev = px;
+  }
+
+  if (run > 0) {
+    bytes[p++] = QOI_OP_RUN | (run - 1);
+  }
+  return p;
+}
+
+static int new_encode_pixels(const unsigned char *pixels, int n_pixels,
+                             int channels, unsigned char *bytes) {
+  qoi_enc_state state;
+  int p;
+
+  qoi_encode_init(&state);
+  p = qoi_encode_pixels(&state, pixels, n_pixels, channels, bytes);
+  return p + qoi_encode_flush(&state, bytes + p);
+}
+
+/* best of several rounds, in MB/s; the encoders take turns in every round so
+ both see the same machine load */
+static void bench_encoders(const unsigned char *px, const qoi_desc *desc,
+                           unsigned char *out, double *ref, double *fast) {
+  int n = desc->width * desc->height;
+  size_t bytes = (size_t) n * desc->channels;
+  int reps = (int) (100e6 / bytes) + 1;
+  double best[2] = {1e30, 1e30};
+
+  for (int round = 0; round < 9; round++) {
+    for (int k = 0; k < 2; k++) {
+      double t0 = bench_now();
+      for (int r = 0; r < reps; r++) {
+        if (k == 0)
+          ref_encode_pixels(px, n, desc->channels, out);
+        else
+          new_encode_pixels(px, n, desc->channels, out);
+      }
+      double t = (bench_now() - t0) / reps;
+      if (t < best[k]) best[k] = t;
+    }
+  }
+  *ref = bytes / best[0] / 1e6;
+  *fast = bytes / best[1] / 1e6;
+}
+
+static void bench_one(const char *name, const unsigned char *px, const qoi_desc *desc) {
+  int n = desc->width * desc->height, n_ref, n_new;
+  unsigned char *a = malloc(qoi_encode_max_size(desc));
+  unsigned char *b = malloc(qoi_encode_max_size(desc));
+
+  n_ref = ref_encode_pixels(px, n, desc->channels, a);
+  n_new = new_encode_pixels(px, n, desc->channels, b);
+  if (n_ref != n_new || memcmp(a, b, n_ref) != 0)
+    printf("%s: MISMATCH\n", name);
+
+  double ref, fast;
+  bench_encoders(px, desc, a, &ref, &fast);
+  printf("%-28s %5ux%-5u %d  %8.1f  %8.1f  %5.2fx\n", name, desc->width,
+         desc->height, desc->channels, ref, fast, fast / ref);
+  free(a);
+  free(b);
+}
+
+static unsigned char *read_file(const char *fn, size_t *size) {
+  FILE *f = fopen(fn, "rb");
+  unsigned char *data;
+
+  if (!f) return NULL;
+  fseek(f, 0, SEEK_END);
+  *size = (size_t) ftell(f);
+  rewind(f);
+  data = malloc(*size);
+  if (fread(data, 1, *size, f) != *size) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  return data;
+}
+
+int main(int argc, char **argv) {
+  static const char *bundled[] = {
+    "inst/extdata/Rlogo.qoi", "inst/extdata/qoi_logo.qoi",
+    "inst/extdata/testcard_rgba.qoi"
+  };
+  static const struct {
+    const char *name;
+    void (*fill)(unsigned char *, int, int, int);
+  } kinds[] = {{"photo", bench_photo}, {"ui", bench_ui}, {"noise", bench_noise}};
+  const char **files = argc > 1 ? (const char **) argv + 1 : bundled;
+  int n_files = argc > 1 ? argc - 1 : 3;
+
+  qoi_scan_init();
+  printf("scan kernel: %s\n", qoi_scan_kernel());
+  printf("%-28s %11s %s  %8s  %8s  %6s\n", "image", "size", "c",
+         "ref MB/s", "new MB/s", "speedup");
+
+  for (int i = 0; i < n_files; i++) {
+    qoi_desc desc;
+    size_t size;
+    unsigned char *data = read_file(files[i], &size), *px;
+    if (!data) {
+      fprintf(stderr, "%s: unable to read\n", files[i]);
+      continue;
+    }
+    px = qoi_decode(data, size, &desc, 0);
+    free(data);
+    if (!px) {
+      fprintf(stderr, "%s: not a QOI image\n", files[i]);
+      continue;
+    }
+    bench_one(files[i], px, &desc);
+    free(px);
+  }
+
+  for (int k = 0; k < 3; k++) {
+    for (int channels = 3; channels <= 4; channels++) {
+      qoi_desc desc = {2000, 2000, channels, QOI_SRGB};
+      unsigned char *px = malloc((size_t) desc.width * desc.height * channels);
+      char name[32];
+
+      kinds[k].fill(px, desc.width, desc.height, channels);
+      snprintf(name, sizeof(name), "synthetic %s", kinds[k].name);
+      bench_one(name, px, &desc);
+      free(px);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+/* Synthetic test images and timing helpers shared by the benchmarks. */
+#ifndef QOI_BENCH_IMAGES_H
+#define QOI_BENCH_IMAGES_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned int bench_rand(unsigned int *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+/* smooth gradients with a little sensor noise */
+static void bench_photo(unsigned char *px, int width, int height, int channels) {
+  unsigned int seed = 1;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      unsigned char *p = px + ((size_t) y * width + x) * channels;
+      double fx = (double) x / width, fy = (double) y / height;
+      p[0] = (unsigned char) (127 + 100 * sin(6 * fx + 2 * fy) + bench_rand(&seed) % 4);
+      p[1] = (unsigned char) (127 + 100 * cos(4 * fy - 3 * fx) + bench_rand(&seed) % 4);
+      p[2] = (unsigned char) (127 + 100 * sin(5 * (fx + fy)) + bench_rand(&seed) % 4);
+      if (channels == 4) p[3] = 255;
+    }
+  }
+}
+
+/* flat panels, borders and text-like specks as in screenshots */
+static void bench_ui(unsigned char *px, int width, int height, int channels) {
+  unsigned int seed = 2;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      unsigned char *p = px + ((size_t) y * width + x) * channels;
+      int panel = (x / 240 + y / 180) % 3;
+      unsigned char v = panel == 0 ? 245 : panel == 1 ? 230 : 32;
+      if (x % 240 == 0 || y % 180 == 0) v = 128;
+      if ((y % 18) < 10 && (x % 240) > 20 && (x % 240) < 200 && bench_rand(&seed) % 7 == 0) v = 0;
+      p[0] = v;
+      p[1] = v;
+      p[2] = panel == 2 ? 64 : v;
+      if (channels == 4) p[3] = 255;
+    }
+  }
+}
+
+/* incompressible noise */
+static void bench_noise(unsigned char *px, int width, int height, int channels) {
+  unsigned int seed = 3;
+  for (size_t i = 0; i < (size_t) width * height * channels; i++) {
+    px[i] = (unsigned char) bench_rand(&seed);
+  }
+}
+
+#endif // QOI_BENCH_IMAGES_H
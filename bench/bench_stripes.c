@@ -0,0 +1,55 @@
+/* Compression cost and wall-clock speedup of striped encoding
+ (writeQOI(stripes = )) against the serial encoder.
+
+ Build and run from the package root:
+
+   cc -O2 -fopenmp -Isrc bench/bench_stripes.c src/image.c src/encode.c \
+     src/decode.c src/scan.c src/transpose.c src/trailer.c -lm -o bench_stripes
+   ./bench_stripes [threads]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qoi.h"
+#include "image.h"
+#include "transpose.h"
+#include "bench_images.h"
+
+int main(int argc, char **argv) {
+  static const struct {
+    const char *name;
+    void (*fill)(unsigned char *, int, int, int);
+  } kinds[] = {{"photo", bench_photo}, {"ui", bench_ui}, {"noise", bench_noise}};
+  static const int stripes[] = {2, 4, 8, 16, 64};
+  int width = 10000, height = 10000, channels = 4;
+  int threads = argc > 1 ? atoi(argv[1]) : 8;
+  qoi_desc desc = {width, height, channels, QOI_SRGB};
+  unsigned char *px = malloc((size_t) width * height * channels);
+
+  qoi_transpose_init();
+  printf("%dx%d RGBA, %d threads\n", width, height, threads);
+  printf("%-6s %7s %11s %9s %8s %8s\n", "image", "stripes", "bytes", "cost", "ms", "speedup");
+
+  for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+    size_t serial_len, len;
+    kinds[k].fill(px, width, height, channels);
+
+    double t0 = bench_now();
+    void *serial = qoi_encode_image(px, 0, &desc, &serial_len);
+    double t_serial = bench_now() - t0;
+    printf("%-6s %7d %11zu %8s %8.0f %8s\n", kinds[k].name, 1, serial_len, "-", t_serial * 1e3, "-");
+
+    for (size_t s = 0; s < sizeof(stripes) / sizeof(stripes[0]); s++) {
+      t0 = bench_now();
+      void *striped = qoi_encode_image_striped(px, QOI_INPUT_RAW, &desc, NULL, stripes[s], threads, &len);
+      double t = bench_now() - t0;
+      printf("%-6s %7d %11zu %+7.3f%% %8.0f %7.2fx\n", kinds[k].name, stripes[s], len,
+             100.0 * ((double) len - serial_len) / serial_len, t * 1e3, t_serial / t);
+      QOI_FREE(striped);
+    }
+    QOI_FREE(serial);
+  }
+
+  free(px);
+  return 0;
+}
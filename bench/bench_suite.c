@@ -0,0 +1,183 @@
+/* Regression suite for the codec itself: qoi_encode() and qoi_decode() are
+ timed on the bundled images and on generated photo-like, flat UI and noise
+ images (see bench_images.h) from 64 x 64 up to 8K. One CSV line is written
+ per image and operation:
+
+   layer,image,width,height,channels,op,seconds,mb_per_s,mpixels_per_s,ratio,peak_kb
+
+ seconds is the best time of several rounds for one call, mb_per_s counts the
+ bytes of raw pixels, ratio is raw size over encoded size and peak_kb the
+ peak resident memory of the process that ran the case (each case runs in a
+ child process of its own, so this includes the input image). The R level is
+ covered by bench_suite.R, which writes the same columns; bench_compare.R
+ compares two such files.
+
+ Build and run from the package root:
+
+   cc -O2 -Isrc bench/bench_suite.c src/decode.c src/encode.c src/scan.c -lm \
+     -o bench_suite
+   ./bench_suite [max_width] > bench_c.csv
+
+ max_width (default 7680) drops the larger generated sizes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "qoi.h"
+#include "scan.h"
+#include "bench_images.h"
+
+/* every measurement takes at least this long, the best of BENCH_ROUNDS
+ rounds is reported */
+#define BENCH_MIN_SECONDS 0.1
+#define BENCH_ROUNDS 5
+
+typedef struct {
+  const char *name;
+  int width, height;
+} bench_size;
+
+static const bench_size sizes[] = {
+  {"64", 64, 64}, {"256", 256, 256}, {"1024", 1024, 1024},
+  {"hd", 1920, 1080}, {"4k", 3840, 2160}, {"8k", 7680, 4320}
+};
+
+static const struct {
+  const char *name;
+  void (*fill)(unsigned char *, int, int, int);
+} kinds[] = {{"photo", bench_photo}, {"ui", bench_ui}, {"noise", bench_noise}};
+
+static unsigned char *read_file(const char *fn, size_t *size) {
+  FILE *f = fopen(fn, "rb");
+  unsigned char *data;
+
+  if (!f) return NULL;
+  fseek(f, 0, SEEK_END);
+  *size = (size_t) ftell(f);
+  rewind(f);
+  data = malloc(*size);
+  if (fread(data, 1, *size, f) != *size) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  return data;
+}
+
+static long peak_kb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static void report(const char *image, const qoi_desc *desc, const char *op,
+                   double seconds, size_t encoded) {
+  double pixels = (double) desc->width * desc->height;
+  double bytes = pixels * desc->channels;
+
+  printf("c,%s,%u,%u,%d,%s,%.6g,%.1f,%.2f,%.4f,%ld\n", image, desc->width,
+         desc->height, desc->channels, op, seconds, bytes / seconds / 1e6,
+         pixels / seconds / 1e6, bytes / encoded, peak_kb());
+  fflush(stdout);
+}
+
+/* best time of one call of qoi_encode() (decode == 0) or qoi_decode() */
+static double bench_op(int decode, const unsigned char *px, const unsigned char *qoi,
+                       size_t qoi_len, const qoi_desc *desc) {
+  double best = 1e30;
+  int reps = 1;
+
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    double t0 = bench_now(), t;
+
+    for (int r = 0; r < reps; r++) {
+      qoi_desc d = *desc;
+      size_t len;
+      void *out = decode ? qoi_decode(qoi, qoi_len, &d, 0) : qoi_encode(px, &d, &len);
+      QOI_FREE(out);
+    }
+    t = bench_now() - t0;
+    if (t < BENCH_MIN_SECONDS && round == 0) {
+      // calibrate the repetitions, this round does not count
+      reps = (int) (BENCH_MIN_SECONDS / (t / reps + 1e-9)) + 1;
+      round--;
+      continue;
+    }
+    if (t / reps < best) best = t / reps;
+  }
+  return best;
+}
+
+/* one image: time both directions in a child process, so its peak memory is
+ not inflated by the cases before it */
+static void bench_case(const char *image, const char *file, int kind,
+                       int width, int height, int channels) {
+  pid_t pid = fork();
+
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid > 0) {
+    waitpid(pid, NULL, 0);
+    return;
+  }
+
+  unsigned char *px, *qoi;
+  qoi_desc desc = {width, height, channels, QOI_SRGB};
+  size_t qoi_len;
+
+  if (file) {
+    unsigned char *data = read_file(file, &qoi_len);
+    px = data ? qoi_decode(data, qoi_len, &desc, 0) : NULL;
+    free(data);
+    if (!px) {
+      fprintf(stderr, "%s: unable to read\n", file);
+      _exit(1);
+    }
+  } else {
+    px = malloc((size_t) width * height * channels);
+    if (!px)
+      _exit(1);
+    kinds[kind].fill(px, width, height, channels);
+  }
+
+  qoi_scan_init();
+  qoi = qoi_encode(px, &desc, &qoi_len);
+  if (!qoi)
+    _exit(1);
+
+  report(image, &desc, "encode", bench_op(0, px, qoi, qoi_len, &desc), qoi_len);
+  report(image, &desc, "decode", bench_op(1, px, qoi, qoi_len, &desc), qoi_len);
+  _exit(0);
+}
+
+int main(int argc, char **argv) {
+  static const char *bundled[] = {
+    "Rlogo", "inst/extdata/Rlogo.qoi",
+    "qoi_logo", "inst/extdata/qoi_logo.qoi",
+    "testcard_rgba", "inst/extdata/testcard_rgba.qoi"
+  };
+  int max_width = argc > 1 ? atoi(argv[1]) : 7680;
+
+  printf("layer,image,width,height,channels,op,seconds,mb_per_s,mpixels_per_s,ratio,peak_kb\n");
+  fflush(stdout);
+
+  for (int i = 0; i < 3; i++)
+    bench_case(bundled[2 * i], bundled[2 * i + 1], 0, 0, 0, 0);
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    if (sizes[s].width > max_width)
+      continue;
+    for (int k = 0; k < 3; k++) {
+      for (int channels = 3; channels <= 4; channels++) {
+        char image[32];
+        snprintf(image, sizeof(image), "%s_%s", kinds[k].name, sizes[s].name);
+        bench_case(image, NULL, k, sizes[s].width, sizes[s].height, channels);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,173 @@
+/* Benchmark of the planar <-> interleaved conversion kernels in
+ src/transpose.c against the straight triple loops readQOI()/writeQOI() used
+ before. For double images the fused kernel is compared with converting to
+ integers first, as array(as.integer(round(x * 255)), dim(x)) does in R.
+
+ Build and run from the package root:
+
+   cc -O2 -Isrc bench/bench_transpose.c src/transpose.c -lm -o bench_transpose
+   ./bench_transpose
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "transpose.h"
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void naive_read(const unsigned char *pixels, int *px, int width, int height, int channels) {
+  int counter = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      for (int c = 0; c < channels; c++) {
+        px[y + x * height + c * height * width] = pixels[counter];
+        counter++;
+      }
+    }
+  }
+}
+
+static void naive_write(const int *dataPtr, unsigned char *rgb_values, int width, int height, int channels) {
+  int counter = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      for (int c = 0; c < channels; c++) {
+        rgb_values[counter] = dataPtr[y + x * height + c * height * width];
+        counter++;
+      }
+    }
+  }
+}
+
+static void naive_quantize(const double *x, int *px, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    px[i] = (int) floor(x[i] * 255 + 0.5);
+  }
+}
+
+/* best of `reps` runs in seconds */
+#define TIME(reps, stmt) ({ double best = 1e30; \
+  for (int r_ = 0; r_ < (reps); r_++) { double t0 = now(); stmt; double t = now() - t0; if (t < best) best = t; } \
+  best; })
+
+static int check_bands(int width, int height, int channels) {
+  size_t n = (size_t) width * height * channels;
+  unsigned char *bytes = malloc(n), *back = malloc(n);
+  int *planar = malloc(n * sizeof(int)), *expected = malloc(n * sizeof(int));
+  int ok = 1;
+
+  for (size_t i = 0; i < n; i++) bytes[i] = (unsigned char) rand();
+  naive_read(bytes, expected, width, height, channels);
+
+  /* convert in uneven bands to exercise all tails */
+  for (int y0 = 0; y0 < height; y0 += 7) {
+    int rows = height - y0 < 7 ? height - y0 : 7;
+    qoi_planar_from_interleaved(bytes + (size_t) y0 * width * channels, planar,
+                                width, height, channels, y0, rows);
+  }
+  ok &= memcmp(planar, expected, n * sizeof(int)) == 0;
+
+  for (int y0 = 0; y0 < height; y0 += 11) {
+    int rows = height - y0 < 11 ? height - y0 : 11;
+    qoi_interleaved_from_planar(planar, back + (size_t) y0 * width * channels,
+                                width, height, channels, y0, rows);
+  }
+  ok &= memcmp(back, bytes, n) == 0;
+
+  free(bytes); free(back); free(planar); free(expected);
+  return ok;
+}
+
+/* doubles with some values out of range against quantizing and clamping
+ them one by one */
+static int check_real(int width, int height, int channels) {
+  size_t n = (size_t) width * height * channels, first = n;
+  double *real = malloc(n * sizeof(double));
+  int *planar = malloc(n * sizeof(int));
+  unsigned char *bytes = malloc(n), *expected = malloc(n);
+  qoi_range range = {0, 0};
+  size_t count = 0;
+  int ok;
+
+  for (size_t i = 0; i < n; i++) {
+    real[i] = rand() / (double) RAND_MAX;
+    if (rand() % 50 == 0) real[i] = (rand() % 2 ? 1.5 : -0.5);
+    if (rand() % 200 == 0) real[i] = NAN;
+    if (!(real[i] >= 0 && real[i] <= 1)) {
+      count++;
+      if (first == n) first = i;
+    }
+    planar[i] = real[i] != real[i] ? 0 : (int) floor(real[i] * 255 + 0.5);
+  }
+  for (size_t i = 0; i < n; i++) {
+    int v = planar[i];
+    planar[i] = v < 0 ? 0 : v > 255 ? 255 : v;
+  }
+  naive_write(planar, expected, width, height, channels);
+
+  for (int y0 = 0; y0 < height; y0 += 13) {
+    int rows = height - y0 < 13 ? height - y0 : 13;
+    qoi_interleaved_from_planar_real(real, bytes + (size_t) y0 * width * channels,
+                                     width, height, channels, y0, rows, &range);
+  }
+  ok = memcmp(bytes, expected, n) == 0 && range.count == count && range.first == first;
+
+  free(real); free(planar); free(bytes); free(expected);
+  return ok;
+}
+
+int main(void) {
+  static const int sizes[][2] = {{1920, 1080}, {3840, 2160}, {7680, 4320}};
+
+  qoi_transpose_init();
+  printf("kernel: %s\n", qoi_transpose_kernel());
+
+  for (int channels = 3; channels <= 4; channels++) {
+    if (!check_bands(37, 29, channels) || !check_bands(131, 67, channels) ||
+        !check_real(37, 29, channels) || !check_real(131, 67, channels)) {
+      printf("MISMATCH for %d channels\n", channels);
+      return 1;
+    }
+  }
+
+  printf("%-10s %2s %-6s %10s %10s %8s\n", "size", "ch", "dir", "naive MB/s", "tiled MB/s", "speedup");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int width = sizes[s][0], height = sizes[s][1];
+    for (int channels = 3; channels <= 4; channels++) {
+      size_t n = (size_t) width * height * channels;
+      unsigned char *bytes = malloc(n);
+      int *planar = malloc(n * sizeof(int));
+      for (size_t i = 0; i < n; i++) bytes[i] = (unsigned char) (i * 2654435761u >> 24);
+
+      double t_naive = TIME(3, naive_read(bytes, planar, width, height, channels));
+      double t_tiled = TIME(3, qoi_planar_from_interleaved(bytes, planar, width, height, channels, 0, height));
+      printf("%4dx%-5d %2d %-6s %10.0f %10.0f %7.2fx\n", width, height, channels, "read",
+             n / t_naive / 1e6, n / t_tiled / 1e6, t_naive / t_tiled);
+
+      t_naive = TIME(3, naive_write(planar, bytes, width, height, channels));
+      t_tiled = TIME(3, qoi_interleaved_from_planar(planar, bytes, width, height, channels, 0, height));
+      printf("%4dx%-5d %2d %-6s %10.0f %10.0f %7.2fx\n", width, height, channels, "write",
+             n / t_naive / 1e6, n / t_tiled / 1e6, t_naive / t_tiled);
+
+      double *real = malloc(n * sizeof(double));
+      for (size_t i = 0; i < n; i++) real[i] = bytes[i] / 255.0;
+      t_naive = TIME(3, (naive_quantize(real, planar, n),
+                         naive_write(planar, bytes, width, height, channels)));
+      t_tiled = TIME(3, qoi_interleaved_from_planar_real(real, bytes, width, height, channels,
+                                                         0, height, NULL));
+      printf("%4dx%-5d %2d %-6s %10.0f %10.0f %7.2fx\n", width, height, channels, "double",
+             n / t_naive / 1e6, n / t_tiled / 1e6, t_naive / t_tiled);
+
+      free(real);
+      free(bytes);
+      free(planar);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,332 @@
+/* Fuzz target for the decoding paths behind readQOI(), qoiIndex() and
+ qoiDecoder(): the whole-image decoder for every output format, region reads
+ with and without a row index, and the streaming decoder fed in pieces.
+ Every path is compared with fuzz_ref_decode(), the plain scalar decoder the
+ package started from, which serves as the oracle.
+
+ The input is a QOI stream. If it contains the index magic "qidx", the bytes
+ from there on are passed as a row index (see seek.h) for the part in front
+ of it, so the fuzzer can also corrupt indices as readQOI(index = ) would
+ receive them.
+
+ The target links the R-free units of src/ only. Build from the package root
+ with libFuzzer:
+
+   clang -g -O1 -fsanitize=fuzzer,address,undefined -Isrc fuzz/fuzz_decode.c \
+     src/decode.c src/encode.c src/scan.c src/image.c src/seek.c \
+     src/transpose.c src/trailer.c -o fuzz_decode
+   ./fuzz_decode -max_len=65536 fuzz/corpus/ inst/extdata/
+
+ or for AFL and plain reproduction (reads the files given or stdin):
+
+   afl-clang-fast -g -O1 -DQOI_FUZZ_MAIN -Isrc fuzz/fuzz_decode.c \
+     src/decode.c src/encode.c src/scan.c src/image.c src/seek.c \
+     src/transpose.c src/trailer.c -o fuzz_decode
+   afl-fuzz -i fuzz/corpus -o findings -- ./fuzz_decode
+
+ fuzz/corpus holds streams that once broke a decoding path; run them with
+ the driver on every file in it after changes to the decoder.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qoi.h"
+#include "image.h"
+#include "seek.h"
+
+/* larger images only slow the fuzzer down without reaching new code */
+#define FUZZ_MAX_PIXELS (1 << 20)
+
+#define FUZZ_CHECK(x) do { if (!(x)) { \
+  fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+  abort(); } } while (0)
+
+/* The reference: one if/else chain over the chunks, checking each against
+ the end marker, as in the original decoder of qoi.h. Returns 0 if a chunk
+ runs into the end marker. */
+static int fuzz_ref_decode(const unsigned char *bytes, size_t size, const qoi_desc *desc,
+                           int channels, unsigned char *pixels) {
+  qoi_rgba_t index[64];
+  qoi_rgba_t px;
+  size_t px_len = (size_t) desc->width * desc->height * channels, px_pos;
+  size_t chunks_len = size - sizeof(qoi_padding), p = QOI_HEADER_SIZE;
+  int run = 0;
+
+  QOI_ZEROARR(index);
+  px.rgba.r = 0;
+  px.rgba.g = 0;
+  px.rgba.b = 0;
+  px.rgba.a = 255;
+
+  for (px_pos = 0; px_pos < px_len; px_pos += channels) {
+    if (run > 0) {
+      run--;
+    }
+    else if (p < chunks_len) {
+      int b1 = bytes[p++];
+
+      if (b1 == QOI_OP_RGB) {
+        if (p + 3 > chunks_len) break;
+        px.rgba.r = bytes[p++];
+        px.rgba.g = bytes[p++];
+        px.rgba.b = bytes[p++];
+      }
+      else if (b1 == QOI_OP_RGBA) {
+        if (p + 4 > chunks_len) break;
+        px.rgba.r = bytes[p++];
+        px.rgba.g = bytes[p++];
+        px.rgba.b = bytes[p++];
+        px.rgba.a = bytes[p++];
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+        px = index[b1];
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+        px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+        px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+        px.rgba.b += ( b1       & 0x03) - 2;
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+        if (p + 1 > chunks_len) break;
+        int b2 = bytes[p++];
+        int vg = (b1 & 0x3f) - 32;
+        px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+        px.rgba.g += vg;
+        px.rgba.b += vg - 8 +  (b2       & 0x0f);
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_RUN) {
+        run = (b1 & 0x3f);
+      }
+
+      index[QOI_COLOR_HASH(px) % 64] = px;
+    }
+
+    pixels[px_pos + 0] = px.rgba.r;
+    pixels[px_pos + 1] = px.rgba.g;
+    pixels[px_pos + 2] = px.rgba.b;
+
+    if (channels == 4) {
+      pixels[px_pos + 3] = px.rgba.a;
+    }
+  }
+
+  return px_pos >= px_len;
+}
+
+/* an image decoded in the layout `format` against the reference pixels
+ (4 channels for the array and nativeRaster layouts) */
+static void fuzz_check_format(const void *out, int format, const qoi_desc *desc,
+                              const unsigned char *ref, const unsigned char *ref4) {
+  size_t width = desc->width, height = desc->height, n_pixels = width * height;
+
+  if (format == QOI_FORMAT_RAW) {
+    FUZZ_CHECK(memcmp(out, ref, n_pixels * desc->channels) == 0);
+  } else if (format == QOI_FORMAT_NATIVE_RASTER) {
+    // packed RGBA, read back byte by byte regardless of the host order
+    const unsigned int *native = (const unsigned int *) out;
+    for (size_t i = 0; i < n_pixels; i++)
+      for (int c = 0; c < 4; c++)
+        FUZZ_CHECK(((native[i] >> (8 * c)) & 255) == ref4[4 * i + c]);
+  } else {
+    // planar height x width x channels, column by column
+    const int *array = (const int *) out;
+    for (size_t y = 0; y < height; y++)
+      for (size_t x = 0; x < width; x++)
+        for (int c = 0; c < desc->channels; c++)
+          FUZZ_CHECK(array[(c * width + x) * height + y] ==
+                     ref[(y * width + x) * desc->channels + c]);
+  }
+}
+
+/* decode the chunks in front of the end marker in pieces whose sizes are
+ taken from the data itself */
+static void fuzz_stream(const unsigned char *data, size_t size, const qoi_desc *desc,
+                        const unsigned char *ref) {
+  size_t n_pixels = (size_t) desc->width * desc->height, px_done = 0;
+  size_t avail = QOI_HEADER_SIZE, step = 0;
+  int channels = desc->channels;
+  unsigned char *pixels = (unsigned char *) malloc((size_t) n_pixels * channels);
+  qoi_dec_state state;
+
+  if (!pixels)
+    return;
+
+  qoi_decode_init(&state);
+  while (px_done < n_pixels) {
+    size_t piece = 1 + data[step++ % size] % 97;
+    size_t got;
+
+    avail = avail + piece < size ? avail + piece : size;
+    got = qoi_decode_partial(&state, data, avail, channels,
+                             pixels + (size_t) px_done * channels,
+                             n_pixels - px_done);
+    FUZZ_CHECK(got <= n_pixels - px_done && state.p <= avail);
+    px_done += got;
+    if (avail == size && got == 0)
+      break;
+  }
+
+  // the whole-image decoder repeats the last pixel once the chunks run out,
+  // so it may get further, but the pixels decoded by both have to agree
+  if (ref)
+    FUZZ_CHECK(memcmp(pixels, ref, (size_t) px_done * channels) == 0);
+  free(pixels);
+}
+
+/* ref is NULL if the pixels need not agree with the reference, i.e. for an
+ index which only passed qoi_index_check() */
+static void fuzz_region(const unsigned char *data, size_t size, const qoi_desc *desc,
+                        const unsigned char *index, const unsigned char *ref) {
+  int width = desc->width, height = desc->height, channels = desc->channels;
+  int x0 = data[size - 1] % width, y0 = data[size - 2] % height;
+  int w = 1 + data[size - 3] % (width - x0), h = 1 + data[size - 4] % (height - y0);
+  unsigned char *out = (unsigned char *) malloc((size_t) w * h * channels);
+  int ok;
+
+  if (!out)
+    return;
+
+  ok = qoi_decode_region(data, size, desc, index, x0, y0, w, h, channels, out);
+  if (ok && ref) {
+    for (int y = 0; y < h; y++)
+      FUZZ_CHECK(memcmp(out + (size_t) y * w * channels,
+                        ref + ((size_t) (y0 + y) * width + x0) * channels,
+                        (size_t) w * channels) == 0);
+  }
+  free(out);
+}
+
+int LLVMFuzzerTestOneInput(const unsigned char *data, size_t len) {
+  const unsigned char *index = NULL;
+  size_t index_len = 0;
+  unsigned char *ref, *ref4, *pixels, *built;
+  qoi_desc desc;
+  size_t size, n_pixels;
+  int ref_ok, ref4_ok;
+
+  for (size_t i = QOI_HEADER_SIZE; i + 4 <= len; i++) {
+    if (memcmp(data + i, QOI_INDEX_MAGIC, 4) == 0) {
+      index = data + i;
+      index_len = len - i;
+      len = i;
+      break;
+    }
+  }
+
+  if (!qoi_decode_header(data, len, &desc))
+    return 0;
+  size = len;
+  n_pixels = (size_t) desc.width * desc.height;
+  if (n_pixels > FUZZ_MAX_PIXELS)
+    return 0;
+
+  ref = (unsigned char *) malloc(n_pixels * desc.channels);
+  ref4 = (unsigned char *) malloc(n_pixels * 4);
+  pixels = (unsigned char *) malloc(n_pixels * 4);
+  if (!ref || !ref4 || !pixels) {
+    free(ref);
+    free(ref4);
+    free(pixels);
+    return 0;
+  }
+  ref_ok = fuzz_ref_decode(data, size, &desc, desc.channels, ref);
+  ref4_ok = fuzz_ref_decode(data, size, &desc, 4, ref4);
+  FUZZ_CHECK(ref_ok == ref4_ok);
+
+  // the decoder itself, with the image's channels and with 4
+  FUZZ_CHECK(qoi_decode_pixels(data, size, &desc, desc.channels, pixels) == ref_ok);
+  if (ref_ok)
+    FUZZ_CHECK(memcmp(pixels, ref, n_pixels * desc.channels) == 0);
+  FUZZ_CHECK(qoi_decode_pixels(data, size, &desc, 4, pixels) == ref_ok);
+  if (ref_ok)
+    FUZZ_CHECK(memcmp(pixels, ref4, n_pixels * 4) == 0);
+  free(pixels);
+
+  // every output format of readQOI()
+  for (int format = QOI_FORMAT_ARRAY; format <= QOI_FORMAT_NATIVE_RASTER; format++) {
+    int channels = format == QOI_FORMAT_RAW ? desc.channels : 4;
+    void *out = malloc(n_pixels * channels * (format == QOI_FORMAT_RAW ? 1 : sizeof(int)));
+    if (out) {
+      int ok = qoi_decode_image(data, size, &desc, format, out);
+      FUZZ_CHECK(ok == ref_ok);
+      if (ok)
+        fuzz_check_format(out, format, &desc, ref, ref4);
+      free(out);
+    }
+  }
+
+  if (!ref_ok) {
+    free(ref);
+    ref = NULL;
+  }
+  free(ref4);
+
+  fuzz_stream(data, size - sizeof(qoi_padding), &desc, ref);
+  fuzz_region(data, size, &desc, NULL, ref);
+
+  // an index built from the data has to lead to the same pixels
+  built = (unsigned char *) malloc(qoi_index_size(&desc, 1 + data[size - 5] % 8));
+  if (built) {
+    int every = 1 + data[size - 5] % 8;
+    if (qoi_index_build(data, size, &desc, every, built)) {
+      FUZZ_CHECK(qoi_index_check(built, qoi_index_size(&desc, every), &desc, size));
+      fuzz_region(data, size, &desc, built, ref);
+    }
+    free(built);
+  }
+
+  // a foreign index is only used once it passed the check, like in readQOI()
+  if (index && qoi_index_check(index, index_len, &desc, size))
+    fuzz_region(data, size, &desc, index, NULL);
+
+  // whatever decodes has to survive a round trip through the encoder
+  if (ref) {
+    size_t out_len;
+    unsigned char *encoded = (unsigned char *) qoi_encode(ref, &desc, &out_len);
+    FUZZ_CHECK(encoded != NULL);
+    unsigned char *again = (unsigned char *) qoi_decode(encoded, out_len, &desc, desc.channels);
+    FUZZ_CHECK(again && memcmp(again, ref, n_pixels * desc.channels) == 0);
+    free(again);
+    free(encoded);
+    free(ref);
+  }
+  return 0;
+}
+
+#ifdef QOI_FUZZ_MAIN
+static void fuzz_file(FILE *f) {
+  size_t len = 0, cap = 65536;
+  unsigned char *data = (unsigned char *) malloc(cap);
+
+  while (data) {
+    size_t got = fread(data + len, 1, cap - len, f);
+    len += got;
+    if (len < cap)
+      break;
+    unsigned char *grown = (unsigned char *) realloc(data, cap *= 2);
+    if (!grown)
+      free(data);
+    data = grown;
+  }
+  if (data)
+    LLVMFuzzerTestOneInput(data, len);
+  free(data);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fuzz_file(stdin);
+    return 0;
+  }
+  for (int i = 1; i < argc; i++) {
+    FILE *f = fopen(argv[i], "rb");
+    if (!f) {
+      fprintf(stderr, "%s: unable to read\n", argv[i]);
+      continue;
+    }
+    fuzz_file(f);
+    fclose(f);
+  }
+  return 0;
+}
+#endif
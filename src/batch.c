@@ -0,0 +1,356 @@
+#include <R.h>
+#include <Rinternals.h>
+
+#include <stdio.h>
+#include "qoi.h"
+#include "image.h"
+#include "mapfile.h"
+#include "rqoi.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* Batch versions of readQOI() and writeQOI(). Everything that touches the R
+ API (allocating results, reading arguments) happens on the main thread; the
+ workers only see plain C pointers obtained beforehand and report per item
+ status codes which are turned into warnings afterwards. */
+
+#define QOI_BATCH_OK       0
+#define QOI_BATCH_EOPEN    1
+#define QOI_BATCH_EFORMAT  2
+#define QOI_BATCH_EDECODE  3
+#define QOI_BATCH_EWRITE   4
+
+static const char *qoi_batch_message(int status) {
+  switch (status) {
+  case QOI_BATCH_EOPEN:   return "unable to open";
+  case QOI_BATCH_EFORMAT: return "wrong file format";
+  case QOI_BATCH_EDECODE: return "decoding went wrong";
+  default:                return "unable to write";
+  }
+}
+
+static void qoi_batch_warn(SEXP paths, const int *status, R_xlen_t n) {
+  R_xlen_t failed = 0, first = -1;
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (status[i] != QOI_BATCH_OK) {
+      if (first < 0) first = i;
+      failed++;
+    }
+  }
+
+  if (failed > 0)
+    Rf_warning("%d of %d images failed, first: %s (%s)", (int) failed, (int) n,
+               CHAR(STRING_ELT(paths, first)), qoi_batch_message(status[first]));
+}
+
+int qoi_threads(SEXP sThreads) {
+  int threads = asInteger(sThreads);
+
+  if (threads == NA_INTEGER || threads < 1) threads = 1;
+#ifdef _OPENMP
+  if (threads > omp_get_num_procs()) threads = omp_get_num_procs();
+#else
+  threads = 1;
+#endif
+  return threads;
+}
+
+static int qoi_read_desc(const char *fn, qoi_desc *desc, size_t *file_size) {
+  unsigned char header[QOI_HEADER_SIZE];
+  size_t size;
+
+  if (qoi_read_file_head(fn, header, QOI_HEADER_SIZE, &size) != QOI_MAP_OK)
+    return QOI_BATCH_EOPEN;
+  // only the header is validated here, the size covers the rest of the file
+  if (!qoi_decode_header(header, size, desc))
+    return QOI_BATCH_EFORMAT;
+  *file_size = size;
+  return QOI_BATCH_OK;
+}
+
+/* Map a file whose header was read before, status QOI_BATCH_OK means it is
+ mapped and has to be unmapped */
+static int qoi_map_checked(const char *fn, const qoi_desc *desc, qoi_file_map *map) {
+  qoi_desc check;
+
+  if (qoi_map_file(fn, map) != QOI_MAP_OK)
+    return QOI_BATCH_EOPEN;
+
+  // the file may have changed since its header was read
+  if (!qoi_decode_header(map->data, map->size, &check) ||
+      check.width != desc->width || check.height != desc->height ||
+      check.channels != desc->channels) {
+    qoi_unmap_file(map);
+    return QOI_BATCH_EFORMAT;
+  }
+  return QOI_BATCH_OK;
+}
+
+static int qoi_read_into(const char *fn, const qoi_desc *desc, int format, void *out) {
+  qoi_file_map map;
+  int status = qoi_map_checked(fn, desc, &map);
+
+  if (status != QOI_BATCH_OK)
+    return status;
+  if (!qoi_decode_image(map.data, map.size, desc, format, out))
+    status = QOI_BATCH_EDECODE;
+  qoi_unmap_file(&map);
+  return status;
+}
+
+SEXP qoiReadBatch_(SEXP sPaths, SEXP sFormat, SEXP sThreads) {
+  int format = asInteger(sFormat);
+  int threads = qoi_threads(sThreads);
+
+  if (TYPEOF(sPaths) != STRSXP) Rf_error("paths must be a character vector");
+  if (format < QOI_FORMAT_ARRAY || format > QOI_FORMAT_NATIVE_RASTER)
+    Rf_error("invalid output format");
+
+  R_xlen_t n = XLENGTH(sPaths);
+  const char **fn = (const char **) R_alloc(n, sizeof(const char *));
+  qoi_desc *desc = (qoi_desc *) R_alloc(n, sizeof(qoi_desc));
+  void **out = (void **) R_alloc(n, sizeof(void *));
+  int *status = (int *) R_alloc(n, sizeof(int));
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    fn[i] = STRING_ELT(sPaths, i) == NA_STRING ? "" : CHAR(STRING_ELT(sPaths, i));
+  }
+
+  // (1) headers only, to know the size of every result
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+#endif
+  for (R_xlen_t i = 0; i < n; i++) {
+    size_t size;
+    status[i] = qoi_read_desc(fn[i], &desc[i], &size);
+  }
+
+  // (2) allocate all results on the main thread
+  SEXP res = PROTECT(allocVector(VECSXP, n));
+  for (R_xlen_t i = 0; i < n; i++) {
+    out[i] = NULL;
+    if (status[i] == QOI_BATCH_OK) {
+      SET_VECTOR_ELT(res, i, qoi_alloc_image(&desc[i], format));
+      out[i] = qoi_image_data(VECTOR_ELT(res, i));
+    }
+  }
+
+  // (3) decode straight into the results
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+#endif
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (status[i] == QOI_BATCH_OK)
+      status[i] = qoi_read_into(fn[i], &desc[i], format, out[i]);
+  }
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (status[i] != QOI_BATCH_OK)
+      SET_VECTOR_ELT(res, i, R_NilValue);
+  }
+  qoi_batch_warn(sPaths, status, n);
+
+  UNPROTECT(1);
+  return res;
+}
+
+#define QOI_STACK_HWCN 0 /* height x width x channels x n */
+#define QOI_STACK_NCHW 1 /* n x channels x height x width */
+
+/* Image i of a stack, decoded straight into its slice of the result */
+static int qoi_read_stacked(const char *fn, const qoi_desc *desc, int layout,
+                            int *out, size_t i, size_t n) {
+  size_t slice = (size_t) desc->width * desc->height * desc->channels;
+  qoi_file_map map;
+  int ok, status = qoi_map_checked(fn, desc, &map);
+
+  if (status != QOI_BATCH_OK)
+    return status;
+  if (layout == QOI_STACK_NCHW)
+    ok = qoi_decode_image_nchw(map.data, map.size, desc, out, i, n);
+  else
+    ok = qoi_decode_image(map.data, map.size, desc, QOI_FORMAT_ARRAY, out + i * slice);
+  qoi_unmap_file(&map);
+  return ok ? QOI_BATCH_OK : QOI_BATCH_EDECODE;
+}
+
+SEXP qoiReadStack_(SEXP sPaths, SEXP sLayout, SEXP sThreads) {
+  int layout = asInteger(sLayout);
+  int threads = qoi_threads(sThreads);
+  R_xlen_t failed = -1;
+
+  if (TYPEOF(sPaths) != STRSXP || XLENGTH(sPaths) < 1)
+    Rf_error("paths must be a character vector with at least one path");
+  if (layout != QOI_STACK_HWCN && layout != QOI_STACK_NCHW)
+    Rf_error("invalid layout");
+
+  R_xlen_t n = XLENGTH(sPaths);
+  const char **fn = (const char **) R_alloc(n, sizeof(const char *));
+  qoi_desc *desc = (qoi_desc *) R_alloc(n, sizeof(qoi_desc));
+  int *status = (int *) R_alloc(n, sizeof(int));
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    fn[i] = STRING_ELT(sPaths, i) == NA_STRING ? "" : CHAR(STRING_ELT(sPaths, i));
+  }
+
+  // (1) headers only: every image has to fit into the stack before anything
+  // is allocated
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+  for (R_xlen_t i = 0; i < n; i++) {
+    size_t size;
+    status[i] = qoi_read_desc(fn[i], &desc[i], &size);
+  }
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (status[i] != QOI_BATCH_OK)
+      Rf_error("%s: %s", fn[i], qoi_batch_message(status[i]));
+    if (desc[i].width != desc[0].width || desc[i].height != desc[0].height ||
+        desc[i].channels != desc[0].channels)
+      Rf_error("%s is %u x %u with %d channels, unlike %s (%u x %u with %d channels)",
+               fn[i], desc[i].width, desc[i].height, desc[i].channels,
+               fn[0], desc[0].width, desc[0].height, desc[0].channels);
+  }
+  if ((double) desc[0].width * desc[0].height * desc[0].channels * n > R_XLEN_T_MAX)
+    Rf_error("the stack of %d images is too large", (int) n);
+
+  // (2) the result is allocated once
+  SEXP res = PROTECT(allocVector(INTSXP, (R_xlen_t) desc[0].width * desc[0].height *
+                                 desc[0].channels * n));
+  SEXP dim = PROTECT(allocVector(INTSXP, 4));
+  int *d = INTEGER(dim);
+  if (layout == QOI_STACK_NCHW) {
+    d[0] = (int) n; d[1] = desc[0].channels; d[2] = desc[0].height; d[3] = desc[0].width;
+  } else {
+    d[0] = desc[0].height; d[1] = desc[0].width; d[2] = desc[0].channels; d[3] = (int) n;
+  }
+  setAttrib(res, R_DimSymbol, dim);
+  int *out = INTEGER(res);
+
+  // (3) every image is decoded straight into its slice
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+#endif
+  for (R_xlen_t i = 0; i < n; i++) {
+    status[i] = qoi_read_stacked(fn[i], &desc[i], layout, out, (size_t) i, (size_t) n);
+  }
+
+  for (R_xlen_t i = 0; i < n && failed < 0; i++) {
+    if (status[i] != QOI_BATCH_OK)
+      failed = i;
+  }
+  if (failed >= 0)
+    Rf_error("%s: %s", fn[failed], qoi_batch_message(status[failed]));
+
+  UNPROTECT(2);
+  return res;
+}
+
+SEXP qoiInfo_(SEXP sPaths, SEXP sThreads) {
+  static const char *names[] = {"width", "height", "channels", "colorspace", "file_size"};
+  int threads = qoi_threads(sThreads);
+
+  if (TYPEOF(sPaths) != STRSXP) Rf_error("paths must be a character vector");
+
+  R_xlen_t n = XLENGTH(sPaths);
+  const char **fn = (const char **) R_alloc(n, sizeof(const char *));
+  qoi_desc *desc = (qoi_desc *) R_alloc(n, sizeof(qoi_desc));
+  size_t *size = (size_t *) R_alloc(n, sizeof(size_t));
+  int *status = (int *) R_alloc(n, sizeof(int));
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    fn[i] = STRING_ELT(sPaths, i) == NA_STRING ? "" : CHAR(STRING_ELT(sPaths, i));
+  }
+
+  // headers only, with one small read per file
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+  for (R_xlen_t i = 0; i < n; i++) {
+    status[i] = qoi_read_desc(fn[i], &desc[i], &size[i]);
+  }
+
+  // one column per header field, NA for files which could not be read
+  SEXP res = PROTECT(allocVector(VECSXP, 5));
+  SEXP nms = PROTECT(allocVector(STRSXP, 5));
+  for (int j = 0; j < 5; j++) {
+    SET_VECTOR_ELT(res, j, allocVector(j < 4 ? INTSXP : REALSXP, n));
+    SET_STRING_ELT(nms, j, mkChar(names[j]));
+  }
+  setAttrib(res, R_NamesSymbol, nms);
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    int ok = status[i] == QOI_BATCH_OK;
+    INTEGER(VECTOR_ELT(res, 0))[i] = ok ? (int) desc[i].width : NA_INTEGER;
+    INTEGER(VECTOR_ELT(res, 1))[i] = ok ? (int) desc[i].height : NA_INTEGER;
+    INTEGER(VECTOR_ELT(res, 2))[i] = ok ? desc[i].channels : NA_INTEGER;
+    INTEGER(VECTOR_ELT(res, 3))[i] = ok ? desc[i].colorspace : NA_INTEGER;
+    REAL(VECTOR_ELT(res, 4))[i] = ok ? (double) size[i] : NA_REAL;
+  }
+  qoi_batch_warn(sPaths, status, n);
+
+  UNPROTECT(2);
+  return res;
+}
+
+static int qoi_write_from(const char *fn, const void *data, int input, const qoi_desc *desc) {
+  size_t size;
+  int status = QOI_BATCH_OK;
+  void *encoded = qoi_encode_image(data, input, desc, &size);
+  FILE *f;
+
+  if (!encoded)
+    return QOI_BATCH_EWRITE;
+
+  f = fopen(fn, "wb");
+  if (!f || fwrite(encoded, 1, size, f) != size)
+    status = QOI_BATCH_EWRITE;
+  if (f && fclose(f) != 0)
+    status = QOI_BATCH_EWRITE;
+
+  QOI_FREE(encoded);
+  return status;
+}
+
+SEXP qoiWriteBatch_(SEXP sImages, SEXP sPaths, SEXP sThreads) {
+  int threads = qoi_threads(sThreads);
+
+  if (TYPEOF(sImages) != VECSXP) Rf_error("images must be a list");
+  if (TYPEOF(sPaths) != STRSXP || XLENGTH(sPaths) != XLENGTH(sImages))
+    Rf_error("paths must be a character vector with one path per image");
+
+  R_xlen_t n = XLENGTH(sImages);
+  const char **fn = (const char **) R_alloc(n, sizeof(const char *));
+  qoi_desc *desc = (qoi_desc *) R_alloc(n, sizeof(qoi_desc));
+  const void **data = (const void **) R_alloc(n, sizeof(void *));
+  int *input = (int *) R_alloc(n, sizeof(int));
+  int *status = (int *) R_alloc(n, sizeof(int));
+
+  // validate all images before any file is written
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP image = VECTOR_ELT(sImages, i);
+    input[i] = qoi_image_desc(image, &desc[i]);
+    data[i] = qoi_image_data(image);
+    fn[i] = STRING_ELT(sPaths, i) == NA_STRING ? "" : CHAR(STRING_ELT(sPaths, i));
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+#endif
+  for (R_xlen_t i = 0; i < n; i++) {
+    status[i] = qoi_write_from(fn[i], data[i], input[i], &desc[i]);
+  }
+
+  SEXP res = PROTECT(allocVector(LGLSXP, n));
+  for (R_xlen_t i = 0; i < n; i++) {
+    LOGICAL(res)[i] = status[i] == QOI_BATCH_OK;
+  }
+  qoi_batch_warn(sPaths, status, n);
+
+  UNPROTECT(1);
+  return res;
+}
@@ -0,0 +1,50 @@
+#ifndef QOI_BUFFER_H
+#define QOI_BUFFER_H
+
+#include <stdlib.h>
+#include "qoi.h"
+
+/* A heap buffer which is kept across calls and only ever grows, so that
+ repeated calls for images of the same size (see qoiContext()) allocate
+ nothing once it has reached the size of the largest one. */
+typedef struct {
+  unsigned char *bytes;
+  size_t cap;
+} qoi_buffer;
+
+/* Memory for size bytes: the bytes of buf, grown first if they are too few,
+ or without a buffer (buf == NULL) a new allocation which has to be handed to
+ qoi_buffer_release() afterwards. Returns NULL if it could not be allocated;
+ buf is left as it was then. */
+static inline unsigned char *qoi_buffer_take(qoi_buffer *buf, size_t size) {
+  unsigned char *bytes;
+
+  if (!buf)
+    return (unsigned char *) QOI_MALLOC(size ? size : 1);
+  if (buf->cap >= size && buf->bytes)
+    return buf->bytes;
+
+  // the old content is not needed, so there is nothing to copy
+  bytes = (unsigned char *) QOI_MALLOC(size ? size : 1);
+  if (!bytes)
+    return NULL;
+  if (buf->bytes)
+    QOI_FREE(buf->bytes);
+  buf->bytes = bytes;
+  buf->cap = size;
+  return bytes;
+}
+
+static inline void qoi_buffer_release(qoi_buffer *buf, unsigned char *bytes) {
+  if (!buf && bytes)
+    QOI_FREE(bytes);
+}
+
+static inline void qoi_buffer_free(qoi_buffer *buf) {
+  if (buf->bytes)
+    QOI_FREE(buf->bytes);
+  buf->bytes = NULL;
+  buf->cap = 0;
+}
+
+#endif // QOI_BUFFER_H
@@ -0,0 +1,537 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "canvas.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+int qoi_canvas_init(qoi_canvas *cv, int width, int height) {
+  memset(cv, 0, sizeof(qoi_canvas));
+  cv->width = width;
+  cv->height = height;
+  cv->pixels = (unsigned char *) malloc((size_t) width * height * 4);
+  // one more for the end of spans at the right border
+  cv->cover = (float *) calloc((size_t) width + 1, sizeof(float));
+  cv->delta = (float *) calloc((size_t) width + 1, sizeof(float));
+  if (!cv->pixels || !cv->cover || !cv->delta) {
+    qoi_canvas_free(cv);
+    return 0;
+  }
+  cv->clip[2] = width;
+  cv->clip[3] = height;
+  return 1;
+}
+
+void qoi_canvas_free(qoi_canvas *cv) {
+  free(cv->pixels);
+  free(cv->cover);
+  free(cv->delta);
+  free(cv->edges);
+  free(cv->active);
+  free(cv->crossings);
+  free(cv->px);
+  free(cv->py);
+  memset(cv, 0, sizeof(qoi_canvas));
+}
+
+void qoi_canvas_clear(qoi_canvas *cv, const unsigned char *rgba) {
+  size_t n = (size_t) cv->width * cv->height;
+
+  for (size_t i = 0; i < n; i++)
+    memcpy(cv->pixels + 4 * i, rgba, 4);
+  qoi_canvas_clip(cv, 0, 0, cv->width, cv->height);
+}
+
+void qoi_canvas_clip(qoi_canvas *cv, double left, double top, double right,
+                     double bottom) {
+  cv->clip[0] = left < 0 ? 0 : left;
+  cv->clip[1] = top < 0 ? 0 : top;
+  cv->clip[2] = right > cv->width ? cv->width : right;
+  cv->clip[3] = bottom > cv->height ? cv->height : bottom;
+}
+
+/* -----------------------------------------------------------------------------
+ Building the path */
+
+static void qoi_canvas_edge(qoi_canvas *cv, double x0, double y0, double x1, double y1) {
+  qoi_edge *e;
+
+  // horizontal edges never cross a sample row
+  if (y0 == y1 || cv->failed)
+    return;
+
+  if (cv->n_edges == cv->cap_edges) {
+    size_t cap = cv->cap_edges ? 2 * cv->cap_edges : 256;
+    qoi_edge *edges = (qoi_edge *) realloc(cv->edges, cap * sizeof(qoi_edge));
+    size_t *active;
+    qoi_crossing *crossings;
+
+    if (edges)
+      cv->edges = edges;
+    active = (size_t *) realloc(cv->active, cap * sizeof(size_t));
+    if (active)
+      cv->active = active;
+    crossings = (qoi_crossing *) realloc(cv->crossings, cap * sizeof(qoi_crossing));
+    if (crossings)
+      cv->crossings = crossings;
+    if (!edges || !active || !crossings) {
+      cv->failed = 1;
+      return;
+    }
+    cv->cap_edges = cap;
+  }
+
+  e = &cv->edges[cv->n_edges++];
+  if (y0 < y1) {
+    e->x0 = x0; e->y0 = y0; e->x1 = x1; e->y1 = y1; e->dir = 1;
+  } else {
+    e->x0 = x1; e->y0 = y1; e->x1 = x0; e->y1 = y0; e->dir = -1;
+  }
+}
+
+void qoi_canvas_polygon(qoi_canvas *cv, const double *x, const double *y, int n) {
+  for (int i = 0; i < n; i++) {
+    if (!isfinite(x[i]) || !isfinite(y[i]))
+      return;
+  }
+  for (int i = 0; i < n; i++) {
+    int j = i + 1 < n ? i + 1 : 0;
+    qoi_canvas_edge(cv, x[i], y[i], x[j], y[j]);
+  }
+}
+
+/* A piece of a stroke: a polygon added so that it runs clockwise on screen,
+ like all other pieces, which makes their union non-zero everywhere */
+static void qoi_canvas_piece(qoi_canvas *cv, const double *x, const double *y, int n) {
+  double area = 0;
+
+  for (int i = 0; i < n; i++) {
+    int j = i + 1 < n ? i + 1 : 0;
+    area += x[i] * y[j] - x[j] * y[i];
+  }
+  if (area >= 0) {
+    for (int i = 0; i < n; i++)
+      qoi_canvas_edge(cv, x[i], y[i], x[i + 1 < n ? i + 1 : 0], y[i + 1 < n ? i + 1 : 0]);
+  } else {
+    for (int i = 0; i < n; i++)
+      qoi_canvas_edge(cv, x[i + 1 < n ? i + 1 : 0], y[i + 1 < n ? i + 1 : 0], x[i], y[i]);
+  }
+}
+
+int qoi_canvas_circle_points(double cx, double cy, double r, double *x, double *y) {
+  int n = r > 0 ? (int) ceil(2 * M_PI * r) : 8;
+
+  if (n < 8) n = 8;
+  if (n > QOI_CANVAS_CIRCLE_POINTS) n = QOI_CANVAS_CIRCLE_POINTS;
+  for (int i = 0; i < n; i++) {
+    x[i] = cx + r * cos(2 * M_PI * i / n);
+    y[i] = cy + r * sin(2 * M_PI * i / n);
+  }
+  return n;
+}
+
+static void qoi_canvas_circle(qoi_canvas *cv, double cx, double cy, double r) {
+  double x[QOI_CANVAS_CIRCLE_POINTS], y[QOI_CANVAS_CIRCLE_POINTS];
+
+  qoi_canvas_piece(cv, x, y, qoi_canvas_circle_points(cx, cy, r, x, y));
+}
+
+/* The rectangle around the line from (x0, y0) to (x1, y1) of width 2h,
+ (nx, ny) being the unit normal of the line */
+static void qoi_canvas_band(qoi_canvas *cv, double x0, double y0, double x1, double y1,
+                            double nx, double ny, double h) {
+  double x[4] = {x0 + nx * h, x1 + nx * h, x1 - nx * h, x0 - nx * h};
+  double y[4] = {y0 + ny * h, y1 + ny * h, y1 - ny * h, y0 - ny * h};
+
+  qoi_canvas_piece(cv, x, y, 4);
+}
+
+/* End of a line at (x, y) running in the direction (dx, dy) */
+static void qoi_canvas_cap(qoi_canvas *cv, double x, double y, double dx, double dy,
+                           const qoi_stroke *stroke) {
+  double h = stroke->width / 2;
+
+  if (stroke->cap == QOI_CANVAS_CAP_ROUND)
+    qoi_canvas_circle(cv, x, y, h);
+  else if (stroke->cap == QOI_CANVAS_CAP_SQUARE)
+    qoi_canvas_band(cv, x, y, x + dx * h, y + dy * h, -dy, dx, h);
+}
+
+/* Corner at (x, y) between a line in direction d1 and one in direction d2 */
+static void qoi_canvas_join(qoi_canvas *cv, double x, double y, double d1x, double d1y,
+                            double d2x, double d2y, const qoi_stroke *stroke) {
+  double h = stroke->width / 2;
+  double n1x = -d1y, n1y = d1x, n2x = -d2y, n2y = d2x;
+  double s, c, px[4], py[4];
+
+  // straight on: the bands already meet
+  if (d1x * d2x + d1y * d2y > 0.9999)
+    return;
+  if (stroke->join == QOI_CANVAS_JOIN_ROUND) {
+    qoi_canvas_circle(cv, x, y, h);
+    return;
+  }
+
+  // the gap opens on the side the line turns away from
+  s = n1x * d2x + n1y * d2y < 0 ? h : -h;
+  px[0] = x; py[0] = y;
+  px[1] = x + s * n1x; py[1] = y + s * n1y;
+  px[3] = x + s * n2x; py[3] = y + s * n2y;
+
+  c = n1x * n2x + n1y * n2y;
+  if (stroke->join == QOI_CANVAS_JOIN_MITRE && 1 + c > 1e-9 &&
+      sqrt(2 / (1 + c)) <= stroke->mitre) {
+    px[2] = x + s * (n1x + n2x) / (1 + c);
+    py[2] = y + s * (n1y + n2y) / (1 + c);
+    qoi_canvas_piece(cv, px, py, 4);
+  } else {
+    px[2] = px[3]; py[2] = py[3];
+    qoi_canvas_piece(cv, px, py, 3);
+  }
+}
+
+/* Outline of a solid line through n points */
+static void qoi_canvas_run(qoi_canvas *cv, const double *x, const double *y, int n,
+                           int closed, const qoi_stroke *stroke) {
+  double h = stroke->width / 2;
+  double fx = 0, fy = 0, fdx = 0, fdy = 0, pdx = 0, pdy = 0, lx = 0, ly = 0;
+  int segments = 0, m = closed ? n : n - 1;
+
+  for (int i = 0; i < m; i++) {
+    int j = i + 1 < n ? i + 1 : 0;
+    double dx = x[j] - x[i], dy = y[j] - y[i], len = sqrt(dx * dx + dy * dy);
+
+    if (len < 1e-9)
+      continue;
+    dx /= len;
+    dy /= len;
+    if (segments == 0) {
+      fx = x[i]; fy = y[i]; fdx = dx; fdy = dy;
+    } else {
+      qoi_canvas_join(cv, x[i], y[i], pdx, pdy, dx, dy, stroke);
+    }
+    qoi_canvas_band(cv, x[i], y[i], x[j], y[j], -dy, dx, h);
+    pdx = dx; pdy = dy;
+    lx = x[j]; ly = y[j];
+    segments++;
+  }
+
+  if (segments == 0) {
+    // a dot, drawn as the caps of a line of length 0 would be
+    if (n > 0 && stroke->cap == QOI_CANVAS_CAP_ROUND)
+      qoi_canvas_circle(cv, x[0], y[0], h);
+    else if (n > 0 && stroke->cap == QOI_CANVAS_CAP_SQUARE)
+      qoi_canvas_band(cv, x[0] - h, y[0], x[0] + h, y[0], 0, 1, h);
+  } else if (closed) {
+    qoi_canvas_join(cv, fx, fy, pdx, pdy, fdx, fdy, stroke);
+  } else {
+    qoi_canvas_cap(cv, fx, fy, -fdx, -fdy, stroke);
+    qoi_canvas_cap(cv, lx, ly, pdx, pdy, stroke);
+  }
+}
+
+static int qoi_canvas_point(qoi_canvas *cv, size_t n, double x, double y) {
+  if (n == cv->cap_points) {
+    size_t cap = cv->cap_points ? 2 * cv->cap_points : 64;
+    double *px = (double *) realloc(cv->px, cap * sizeof(double));
+    double *py;
+
+    if (px)
+      cv->px = px;
+    py = (double *) realloc(cv->py, cap * sizeof(double));
+    if (py)
+      cv->py = py;
+    if (!px || !py) {
+      cv->failed = 1;
+      return 0;
+    }
+    cv->cap_points = cap;
+  }
+  cv->px[n] = x;
+  cv->py[n] = y;
+  return 1;
+}
+
+void qoi_canvas_stroke(qoi_canvas *cv, const double *x, const double *y, int n,
+                       int closed, const qoi_stroke *stroke) {
+  double period = 0, rest;
+  size_t run = 0;
+  int k = 0, on = 1, m;
+
+  for (int i = 0; i < n; i++) {
+    if (!isfinite(x[i]) || !isfinite(y[i]))
+      return;
+  }
+  for (int i = 0; i < stroke->n_dashes; i++)
+    period += stroke->dashes[i];
+  if (n < 1 || stroke->width <= 0)
+    return;
+  if (stroke->n_dashes < 2 || period < 0.5) {
+    qoi_canvas_run(cv, x, y, n, closed, stroke);
+    return;
+  }
+
+  // every dash is a separate open line through the points it passes; a
+  // closed line is dashed from its first point all the way round
+  m = closed ? n : n - 1;
+  rest = stroke->dashes[0];
+  qoi_canvas_point(cv, run++, x[0], y[0]);
+  for (int i = 0; i < m && !cv->failed; i++) {
+    int j = i + 1 < n ? i + 1 : 0;
+    double dx = x[j] - x[i], dy = y[j] - y[i], len = sqrt(dx * dx + dy * dy);
+    double t = 0;
+
+    while (len - t > rest) {
+      t += rest;
+      if (on) {
+        qoi_canvas_point(cv, run++, x[i] + dx * t / len, y[i] + dy * t / len);
+        if (!cv->failed)
+          qoi_canvas_run(cv, cv->px, cv->py, (int) run, 0, stroke);
+        run = 0;
+      } else {
+        qoi_canvas_point(cv, run++, x[i] + dx * t / len, y[i] + dy * t / len);
+      }
+      k = (k + 1) % stroke->n_dashes;
+      rest = stroke->dashes[k];
+      on = !on;
+    }
+    rest -= len - t;
+    if (on)
+      qoi_canvas_point(cv, run++, x[j], y[j]);
+  }
+  if (on && run > 1 && !cv->failed)
+    qoi_canvas_run(cv, cv->px, cv->py, (int) run, 0, stroke);
+}
+
+/* -----------------------------------------------------------------------------
+ Filling the path */
+
+static inline void qoi_canvas_blend(unsigned char *p, const unsigned char *rgba,
+                                    float coverage) {
+  float sa = rgba[3] * (1.0f / 255) * coverage;
+
+  if (p[3] == 255) {
+    for (int c = 0; c < 3; c++)
+      p[c] = (unsigned char) (p[c] + (rgba[c] - p[c]) * sa + 0.5f);
+  } else {
+    float da = p[3] * (1.0f / 255), oa = sa + da * (1 - sa);
+
+    if (oa <= 0)
+      return;
+    for (int c = 0; c < 3; c++)
+      p[c] = (unsigned char) ((rgba[c] * sa + p[c] * da * (1 - sa)) / oa + 0.5f);
+    p[3] = (unsigned char) (oa * 255 + 0.5f);
+  }
+}
+
+static int qoi_edge_cmp(const void *a, const void *b) {
+  double ya = ((const qoi_edge *) a)->y0, yb = ((const qoi_edge *) b)->y0;
+  return (ya > yb) - (ya < yb);
+}
+
+/* Add the part of [xa, xb) within the clip rectangle to the coverage of the
+ row, with weight w per whole pixel */
+static inline void qoi_canvas_span(qoi_canvas *cv, double xa, double xb, float w,
+                                   int *lo, int *hi) {
+  int ia, ib;
+
+  if (xa < cv->clip[0]) xa = cv->clip[0];
+  if (xb > cv->clip[2]) xb = cv->clip[2];
+  if (xb <= xa)
+    return;
+
+  ia = (int) xa;
+  ib = (int) xb;
+  if (ia == ib) {
+    cv->cover[ia] += (float) (xb - xa) * w;
+  } else {
+    cv->cover[ia] += (float) (ia + 1 - xa) * w;
+    cv->delta[ia + 1] += w;
+    cv->delta[ib] -= w;
+    cv->cover[ib] += (float) (xb - ib) * w;
+  }
+  if (ia < *lo) *lo = ia;
+  if (ib > *hi) *hi = ib;
+}
+
+int qoi_canvas_fill(qoi_canvas *cv, const unsigned char *rgba, int evenodd) {
+  size_t n = cv->n_edges, next = 0, n_active = 0;
+  double ymin = INFINITY, ymax = -INFINITY;
+  int r0, r1, ok = !cv->failed;
+  const float w = 1.0f / QOI_CANVAS_SUBROWS;
+
+  cv->n_edges = 0;
+  cv->failed = 0;
+  if (!ok || n == 0 || rgba[3] == 0)
+    return ok;
+
+  for (size_t i = 0; i < n; i++) {
+    if (cv->edges[i].y0 < ymin) ymin = cv->edges[i].y0;
+    if (cv->edges[i].y1 > ymax) ymax = cv->edges[i].y1;
+  }
+  if (ymin < cv->clip[1]) ymin = cv->clip[1];
+  if (ymax > cv->clip[3]) ymax = cv->clip[3];
+  if (ymax <= ymin || cv->clip[2] <= cv->clip[0])
+    return 1;
+  r0 = (int) floor(ymin);
+  r1 = (int) ceil(ymax);
+
+  qsort(cv->edges, n, sizeof(qoi_edge), qoi_edge_cmp);
+
+  for (int row = r0; row < r1; row++) {
+    int lo = cv->width, hi = -1;
+    float acc = 0;
+
+    // skip the rows above the next edge while none is active
+    if (n_active == 0) {
+      if (next == n)
+        break;
+      if (cv->edges[next].y0 > row + 1) {
+        row = (int) floor(cv->edges[next].y0) - 1;
+        continue;
+      }
+    }
+
+    for (int k = 0; k < QOI_CANVAS_SUBROWS; k++) {
+      double sy = row + (k + 0.5) / QOI_CANVAS_SUBROWS;
+      size_t m = 0;
+      int winding = 0;
+      double start = 0;
+
+      while (next < n && cv->edges[next].y0 <= sy)
+        cv->active[n_active++] = next++;
+
+      for (size_t a = 0; a < n_active;) {
+        const qoi_edge *e = &cv->edges[cv->active[a]];
+
+        if (e->y1 <= sy) {
+          cv->active[a] = cv->active[--n_active];
+          continue;
+        }
+        cv->crossings[m].x = e->x0 + (sy - e->y0) * (e->x1 - e->x0) / (e->y1 - e->y0);
+        cv->crossings[m].dir = e->dir;
+        m++;
+        a++;
+      }
+
+      // few crossings per row, mostly in order already
+      for (size_t i = 1; i < m; i++) {
+        qoi_crossing c = cv->crossings[i];
+        size_t j = i;
+        while (j > 0 && cv->crossings[j - 1].x > c.x) {
+          cv->crossings[j] = cv->crossings[j - 1];
+          j--;
+        }
+        cv->crossings[j] = c;
+      }
+
+      for (size_t i = 0; i < m; i++) {
+        int before = evenodd ? winding & 1 : winding != 0, after;
+
+        winding += cv->crossings[i].dir;
+        after = evenodd ? winding & 1 : winding != 0;
+        if (!before && after)
+          start = cv->crossings[i].x;
+        else if (before && !after)
+          qoi_canvas_span(cv, start, cv->crossings[i].x, w, &lo, &hi);
+      }
+    }
+
+    if (hi < 0)
+      continue;
+    for (int x = lo; x <= hi; x++) {
+      float coverage;
+
+      acc += cv->delta[x];
+      coverage = cv->cover[x] + acc;
+      if (x < cv->width && coverage > 1.0f / 512)
+        qoi_canvas_blend(cv->pixels + 4 * ((size_t) row * cv->width + x), rgba,
+                         coverage < 1 ? coverage : 1);
+      cv->cover[x] = 0;
+      cv->delta[x] = 0;
+    }
+  }
+  return 1;
+}
+
+/* -----------------------------------------------------------------------------
+ Images */
+
+void qoi_canvas_image(qoi_canvas *cv, const unsigned char *rgba, int w, int h,
+                      double x, double y, double width, double height,
+                      double rot, int interpolate) {
+  double co = cos(rot * M_PI / 180), si = sin(rot * M_PI / 180);
+  // image pixel (u, v), v from the bottom, lies at (x, y) + u * a + v * b
+  double ax = co * width / w, ay = -si * width / w;
+  double bx = si * height / h, by = co * height / h;
+  double det = ax * by - ay * bx;
+  double cx[4], cy[4], xmin, xmax, ymin, ymax;
+  int x0, x1, y0, y1;
+
+  if (w <= 0 || h <= 0 || fabs(det) < 1e-12)
+    return;
+
+  cx[0] = x; cy[0] = y;
+  cx[1] = x + w * ax; cy[1] = y + w * ay;
+  cx[2] = x + h * bx; cy[2] = y + h * by;
+  cx[3] = cx[1] + h * bx; cy[3] = cy[1] + h * by;
+  xmin = xmax = cx[0];
+  ymin = ymax = cy[0];
+  for (int i = 1; i < 4; i++) {
+    if (cx[i] < xmin) xmin = cx[i];
+    if (cx[i] > xmax) xmax = cx[i];
+    if (cy[i] < ymin) ymin = cy[i];
+    if (cy[i] > ymax) ymax = cy[i];
+  }
+  x0 = (int) floor(xmin > cv->clip[0] ? xmin : cv->clip[0]);
+  x1 = (int) ceil(xmax < cv->clip[2] ? xmax : cv->clip[2]);
+  y0 = (int) floor(ymin > cv->clip[1] ? ymin : cv->clip[1]);
+  y1 = (int) ceil(ymax < cv->clip[3] ? ymax : cv->clip[3]);
+
+  for (int py = y0; py < y1; py++) {
+    for (int px = x0; px < x1; px++) {
+      double dx = px + 0.5 - x, dy = py + 0.5 - y;
+      double u = (dx * by - dy * bx) / det, v = (ax * dy - ay * dx) / det;
+      unsigned char pixel[4];
+
+      // pixels whose centre lies within the clip rectangle and the image
+      if (px + 0.5 < cv->clip[0] || px + 0.5 > cv->clip[2] || py + 0.5 < cv->clip[1] ||
+          py + 0.5 > cv->clip[3] || u < 0 || u >= w || v < 0 || v >= h)
+        continue;
+
+      if (interpolate) {
+        // rows counted from the top, between the centres of the pixels
+        double fu = u - 0.5, fr = h - v - 0.5;
+        int c0 = (int) floor(fu), r0 = (int) floor(fr);
+        double tu = fu - c0, tr = fr - r0, sum[4] = {0, 0, 0, 0};
+
+        for (int k = 0; k < 4; k++) {
+          int c = c0 + (k & 1), r = r0 + (k >> 1);
+          double wt = ((k & 1) ? tu : 1 - tu) * ((k >> 1) ? tr : 1 - tr);
+          const unsigned char *s;
+
+          c = c < 0 ? 0 : c >= w ? w - 1 : c;
+          r = r < 0 ? 0 : r >= h ? h - 1 : r;
+          s = rgba + 4 * ((size_t) r * w + c);
+          // premultiplied, so that transparent pixels do not bleed colour
+          sum[0] += wt * s[0] * s[3];
+          sum[1] += wt * s[1] * s[3];
+          sum[2] += wt * s[2] * s[3];
+          sum[3] += wt * s[3];
+        }
+        if (sum[3] < 0.5)
+          continue;
+        for (int c = 0; c < 3; c++)
+          pixel[c] = (unsigned char) (sum[c] / sum[3] + 0.5);
+        pixel[3] = (unsigned char) (sum[3] + 0.5);
+      } else {
+        int c = (int) u, r = h - 1 - (int) v;
+        memcpy(pixel, rgba + 4 * ((size_t) r * w + c), 4);
+      }
+      if (pixel[3])
+        qoi_canvas_blend(cv->pixels + 4 * ((size_t) py * cv->width + px), pixel, 1);
+    }
+  }
+}
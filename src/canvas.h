@@ -0,0 +1,109 @@
+#ifndef QOI_CANVAS_H
+#define QOI_CANVAS_H
+
+#include <stddef.h>
+
+/* Raster canvas of qoi_device(): an RGBA image (not premultiplied, the layout
+ the QOI encoder takes) which shapes are drawn into with anti-aliasing.
+
+ A shape is collected as a path of closed outlines, added by
+ qoi_canvas_polygon() for fills or by qoi_canvas_stroke() for the outline of a
+ line, and then filled with one colour by qoi_canvas_fill(). Every pixel gets
+ the exact horizontal coverage of the path on QOI_CANVAS_SUBROWS sample rows;
+ the path is cleared afterwards.
+
+ Coordinates are in pixels with the origin at the top left corner of the
+ image; pixel (x, y) covers x .. x + 1 and y .. y + 1. Drawing stays within the
+ clip rectangle. */
+#define QOI_CANVAS_SUBROWS 4
+
+#define QOI_CANVAS_CAP_ROUND  1
+#define QOI_CANVAS_CAP_BUTT   2
+#define QOI_CANVAS_CAP_SQUARE 3
+
+#define QOI_CANVAS_JOIN_ROUND 1
+#define QOI_CANVAS_JOIN_MITRE 2
+#define QOI_CANVAS_JOIN_BEVEL 3
+
+typedef struct {
+  double x0, y0, x1, y1;
+  int dir;  // +1 if the edge runs downwards, -1 if upwards
+} qoi_edge;
+
+typedef struct {
+  double x;
+  int dir;
+} qoi_crossing;
+
+typedef struct {
+  int width;
+  int height;
+  unsigned char *pixels;  // width x height x 4 bytes, row by row
+  double clip[4];         // left, top, right, bottom
+  qoi_edge *edges;        // the path
+  size_t n_edges;
+  size_t cap_edges;
+  size_t *active;         // edges reaching the current sample row ...
+  qoi_crossing *crossings; // ... and where they cross it
+  float *cover;           // coverage of the pixels of a row ...
+  float *delta;           // ... and its changes from pixel to pixel
+  double *px;             // temporary outline of a stroke
+  double *py;
+  size_t cap_points;
+  int failed;             // an allocation for the path failed
+} qoi_canvas;
+
+/* Line style of qoi_canvas_stroke(). dashes holds the lengths of dashes and
+ gaps in pixels, n_dashes of them (0 for a solid line). */
+typedef struct {
+  double width;
+  int cap;
+  int join;
+  double mitre;  // longest mitre relative to the line width
+  const double *dashes;
+  int n_dashes;
+} qoi_stroke;
+
+/* Returns 0 if the canvas could not be allocated */
+int qoi_canvas_init(qoi_canvas *cv, int width, int height);
+void qoi_canvas_free(qoi_canvas *cv);
+
+/* Set every pixel to the colour rgba, also the transparent ones. The clip
+ rectangle becomes the whole canvas. */
+void qoi_canvas_clear(qoi_canvas *cv, const unsigned char *rgba);
+void qoi_canvas_clip(qoi_canvas *cv, double left, double top, double right,
+                     double bottom);
+
+/* Points on the outline of a circle, about one per pixel of its
+ circumference but at least 8 and at most QOI_CANVAS_CIRCLE_POINTS, written to
+ x and y. Returns their number. */
+#define QOI_CANVAS_CIRCLE_POINTS 256
+
+int qoi_canvas_circle_points(double cx, double cy, double r, double *x, double *y);
+
+/* Add the closed outline through the n points to the path */
+void qoi_canvas_polygon(qoi_canvas *cv, const double *x, const double *y, int n);
+
+/* Add the outline of a line through the n points (back to the first one if
+ closed is set) in the given style to the path. The pieces of the outline all
+ run in the same direction, so the path must be filled with the non-zero
+ winding rule. */
+void qoi_canvas_stroke(qoi_canvas *cv, const double *x, const double *y, int n,
+                       int closed, const qoi_stroke *stroke);
+
+/* Blend the colour rgba over the area of the path (using the even-odd rule
+ if evenodd is set, otherwise non-zero winding) and clear the path. Returns 0
+ if the path could not be built completely, in which case nothing is drawn. */
+int qoi_canvas_fill(qoi_canvas *cv, const unsigned char *rgba, int evenodd);
+
+/* Blend an image of w x h RGBA pixels (rows from the top) over the
+ parallelogram whose bottom left corner is (x, y), whose bottom edge is
+ `width` pixels long at the angle rot (degrees counter-clockwise) and whose
+ left edge is `height` pixels long, negative as it runs upwards (as R's
+ graphics engine passes it). Pixels are sampled at the nearest position or,
+ with interpolate set, bilinearly. */
+void qoi_canvas_image(qoi_canvas *cv, const unsigned char *rgba, int w, int h,
+                      double x, double y, double width, double height,
+                      double rot, int interpolate);
+
+#endif // QOI_CANVAS_H
@@ -0,0 +1,102 @@
+#include <R.h>
+#include <Rinternals.h>
+
+#include <stdlib.h>
+#include "image.h"
+#include "rqoi.h"
+
+/* A codec context, see qoiContext(): the buffers of a qoi_context kept alive
+ by an external pointer and freed with it, and the image of the last read
+ with reuse = TRUE in the protected slot of the pointer */
+
+static void qoi_context_finalize(SEXP ptr) {
+  qoi_context *ctx = (qoi_context *) R_ExternalPtrAddr(ptr);
+
+  if (ctx) {
+    qoi_context_free(ctx);
+    free(ctx);
+    R_ClearExternalPtr(ptr);
+  }
+}
+
+qoi_context *qoi_context_get(SEXP ptr) {
+  qoi_context *ctx;
+
+  if (ptr == R_NilValue)
+    return NULL;
+  if (TYPEOF(ptr) != EXTPTRSXP || R_ExternalPtrTag(ptr) != install("qoi_context") ||
+      !(ctx = (qoi_context *) R_ExternalPtrAddr(ptr)))
+    Rf_error("invalid context");
+  return ctx;
+}
+
+SEXP qoiContext_(void) {
+  qoi_context *ctx = (qoi_context *) calloc(1, sizeof(qoi_context));
+  SEXP ptr;
+
+  if (!ctx)
+    Rf_error("unable to allocate the context");
+
+  ptr = PROTECT(R_MakeExternalPtr(ctx, install("qoi_context"), R_NilValue));
+  R_RegisterCFinalizerEx(ptr, qoi_context_finalize, TRUE);
+  UNPROTECT(1);
+  return ptr;
+}
+
+SEXP qoi_context_image(SEXP ptr, int reuse, const qoi_desc *desc, int format) {
+  int expected[3], n_dim = 3, ok;
+  SEXP image, dim;
+
+  if (ptr == R_NilValue || !reuse)
+    return qoi_alloc_image(desc, format);
+
+  switch (format) {
+  case QOI_FORMAT_RAW:
+    expected[0] = desc->channels;
+    expected[1] = desc->width;
+    expected[2] = desc->height;
+    break;
+  case QOI_FORMAT_NATIVE_RASTER:
+    expected[0] = desc->height;
+    expected[1] = desc->width;
+    n_dim = 2;
+    break;
+  default:
+    expected[0] = desc->height;
+    expected[1] = desc->width;
+    expected[2] = desc->channels;
+  }
+
+  // the image of the last read with reuse is kept in the protected slot of
+  // the external pointer
+  image = R_ExternalPtrProtected(ptr);
+  dim = getAttrib(image, R_DimSymbol);
+  ok = TYPEOF(image) == (format == QOI_FORMAT_RAW ? RAWSXP : INTSXP) &&
+    TYPEOF(dim) == INTSXP && LENGTH(dim) == n_dim;
+  for (int i = 0; ok && i < n_dim; i++)
+    ok = INTEGER(dim)[i] == expected[i];
+  if (ok)
+    return image;
+
+  image = PROTECT(qoi_alloc_image(desc, format));
+  R_SetExternalPtrProtected(ptr, image);
+  UNPROTECT(1);
+  return image;
+}
+
+SEXP qoiContextSize_(SEXP ptr) {
+  static const char *names[] = {"input", "scratch", "row", "output"};
+  qoi_context *ctx = qoi_context_get(ptr);
+  const qoi_buffer *buffers[] = {&ctx->input, &ctx->scratch, &ctx->row, &ctx->output};
+  SEXP res = PROTECT(allocVector(REALSXP, 4));
+  SEXP nms = PROTECT(allocVector(STRSXP, 4));
+
+  for (int i = 0; i < 4; i++) {
+    REAL(res)[i] = (double) buffers[i]->cap;
+    SET_STRING_ELT(nms, i, mkChar(names[i]));
+  }
+  setAttrib(res, R_NamesSymbol, nms);
+
+  UNPROTECT(2);
+  return res;
+}
@@ -0,0 +1,366 @@
+#include <stdlib.h>
+#include <string.h>
+#include "qoi.h"
+
+int qoi_decode_header(const void *data, size_t size, qoi_desc *desc) {
+  const unsigned char *bytes;
+  unsigned int header_magic;
+  int p = 0;
+
+  if (
+      data == NULL || desc == NULL ||
+        size < QOI_HEADER_SIZE + sizeof(qoi_padding)
+  ) {
+    return 0;
+  }
+
+  bytes = (const unsigned char *)data;
+
+  header_magic = qoi_read_32(bytes, &p);
+  desc->width = qoi_read_32(bytes, &p);
+  desc->height = qoi_read_32(bytes, &p);
+  desc->channels = bytes[p++];
+  desc->colorspace = bytes[p++];
+
+  if (
+      !qoi_desc_valid(desc) ||
+        desc->channels < 3 || desc->channels > 4 ||
+        desc->colorspace > 1 ||
+        header_magic != QOI_MAGIC
+  ) {
+    return 0;
+  }
+
+  return 1;
+}
+
+void qoi_decode_init(qoi_dec_state *state) {
+  QOI_ZEROARR(state->index);
+  state->px.rgba.r = 0;
+  state->px.rgba.g = 0;
+  state->px.rgba.b = 0;
+  state->px.rgba.a = 255;
+  state->p = QOI_HEADER_SIZE;
+  state->run = 0;
+}
+
+/* Fast decoder. INDEX, DIFF and LUMA chunks, which make up most of a typical
+ stream, are decoded without branching on their tag: both candidate pixels
+ are computed and one is selected, so the CPU does not mispredict between
+ them. The per-tag part of DIFF and LUMA chunks comes from a table. */
+
+/* Channel differences encoded in the first byte of a DIFF chunk
+ (0x40 .. 0x7f) or LUMA chunk (0x80 .. 0xbf) as {dr, dg, db}; for LUMA the
+ second byte adds its two nibbles to dr and db. Zero for the other tags. */
+#define QOI_D(b) {(signed char) ((((b) >> 4) & 3) - 2), \
+  (signed char) ((((b) >> 2) & 3) - 2), (signed char) (((b) & 3) - 2)}
+#define QOI_L(b) {(signed char) (((b) & 0x3f) - 40), \
+  (signed char) (((b) & 0x3f) - 32), (signed char) (((b) & 0x3f) - 40)}
+#define QOI_Z(b) {0, 0, 0}
+#define QOI_4(M, b) M(b), M((b) + 1), M((b) + 2), M((b) + 3)
+#define QOI_16(M, b) QOI_4(M, b), QOI_4(M, (b) + 4), QOI_4(M, (b) + 8), QOI_4(M, (b) + 12)
+#define QOI_64(M, b) QOI_16(M, b), QOI_16(M, (b) + 16), QOI_16(M, (b) + 32), QOI_16(M, (b) + 48)
+
+static const signed char qoi_delta[256][3] = {
+  QOI_64(QOI_Z, 0x00), QOI_64(QOI_D, 0x40), QOI_64(QOI_L, 0x80)
+};
+
+/* runs up to this length are filled with a fixed number of stores */
+#define QOI_SHORT_RUN 8
+
+/* Store one pixel; with `spill` set a 3-channel pixel is written as 4 bytes,
+ the last of which is overwritten by the next pixel */
+QOI_INLINE void qoi_store_px(unsigned char *pixels, qoi_rgba_t px, int channels,
+                             int spill) {
+  if (channels == 4 || spill) {
+    memcpy(pixels, &px, 4);
+  } else {
+    pixels[0] = px.rgba.r;
+    pixels[1] = px.rgba.g;
+    pixels[2] = px.rgba.b;
+  }
+}
+
+QOI_INLINE size_t qoi_fill_px(unsigned char *pixels, qoi_rgba_t px, int n, int channels) {
+  for (int i = 0; i < n - 1; i++)
+    qoi_store_px(pixels + i * channels, px, channels, 1);
+  if (n > 0)
+    qoi_store_px(pixels + (n - 1) * channels, px, channels, 0);
+  return (size_t) n * channels;
+}
+
+/* Decode while every chunk is known to lie in front of chunks_len, which the
+ loop condition guarantees for the longest chunk (5 bytes), so the chunks
+ themselves need no bounds checks. Returns the number of bytes written to
+ pixels; the state is updated through the pointers. This function is inlined
+ once for 3 and once for 4 channels, so `channels` is a constant inside. */
+QOI_INLINE size_t qoi_decode_fast(const unsigned char *bytes, size_t *pp, size_t chunks_len,
+                                  qoi_rgba_t *index, qoi_rgba_t *ppx, int *prun,
+                                  unsigned char *pixels, size_t px_len, int channels) {
+  qoi_rgba_t px = *ppx;
+  size_t p = *pp, px_pos = 0;
+  int run = *prun;
+
+  // a run left over from the previous call
+  if (run > 0) {
+    index[QOI_PX_HASH(px)] = px;
+    int n = px_len / channels < (size_t) run ? (int) (px_len / channels) : run;
+    px_pos += qoi_fill_px(pixels, px, n, channels);
+    run -= n;
+  }
+
+  // the loop stops one pixel early for 3 channels, so every pixel stored in
+  // it has room for a 4 byte store
+  while (px_pos + (channels == 3 ? 3 : 0) < px_len && p + 5 <= chunks_len) {
+    int b1 = bytes[p];
+
+    if (b1 < QOI_OP_RUN) {
+      // INDEX, DIFF or LUMA: b2 is only used (and skipped) for LUMA
+      int luma = b1 >> 7, b2 = bytes[p + 1] & -luma;
+      const signed char *d = qoi_delta[b1];
+      qoi_rgba_t next = px;
+
+      next.rgba.r += d[0] + (b2 >> 4);
+      next.rgba.g += d[1];
+      next.rgba.b += d[2] + (b2 & 0x0f);
+      px = b1 < QOI_OP_DIFF ? index[b1] : next;
+      p += 1 + luma;
+    }
+    else if (b1 < QOI_OP_RGB) {
+      int n = (b1 & 0x3f) + 1;
+      size_t left = (px_len - px_pos) / channels;
+      p++;
+      // like every chunk, a run puts its pixel into the index (once is enough)
+      index[QOI_PX_HASH(px)] = px;
+      if (n <= QOI_SHORT_RUN && left > QOI_SHORT_RUN) {
+        // short runs are written with a fixed number of stores, the pixels
+        // beyond the run are overwritten by the following chunks
+        for (int i = 0; i < QOI_SHORT_RUN; i++)
+          qoi_store_px(pixels + px_pos + i * channels, px, channels, 1);
+        px_pos += n * channels;
+        continue;
+      }
+      if ((size_t) n > left) {
+        run = n - (int) left;
+        n = (int) left;
+      }
+      px_pos += qoi_fill_px(pixels + px_pos, px, n, channels);
+      continue;
+    }
+    else {
+      // RGB keeps the alpha of the previous pixel, RGBA replaces it
+      qoi_rgba_t rgba;
+      memcpy(&rgba, bytes + p + 1, 4);
+      if (b1 == QOI_OP_RGB)
+        rgba.rgba.a = px.rgba.a;
+      px = rgba;
+      p += b1 == QOI_OP_RGB ? 4 : 5;
+    }
+
+    index[QOI_PX_HASH(px)] = px;
+    qoi_store_px(pixels + px_pos, px, channels, 1);
+    px_pos += channels;
+  }
+
+  *ppx = px;
+  *pp = p;
+  *prun = run;
+  return px_pos;
+}
+
+int qoi_decode_resume(qoi_dec_state *state, const void *data, size_t size,
+                      int channels, unsigned char *pixels, size_t n_pixels) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  qoi_rgba_t index[64];
+  qoi_rgba_t px = state->px;
+  size_t px_len, chunks_len, px_pos;
+  size_t p = state->p;
+  int run = state->run;
+
+  px_len = n_pixels * channels;
+  memcpy(index, state->index, sizeof(index));
+
+  /* Every chunk must lie completely in front of the padding. A chunk whose
+   operands would run into (or past) the end marker means the stream is
+   truncated or corrupt, so decoding is aborted instead of reading on. */
+  if (size < QOI_HEADER_SIZE + sizeof(qoi_padding))
+    return 0;
+  chunks_len = size - sizeof(qoi_padding);
+
+  // the bulk of the stream, then the last few chunks with every check
+  if (channels == 4)
+    px_pos = qoi_decode_fast(bytes, &p, chunks_len, index, &px, &run, pixels, px_len, 4);
+  else
+    px_pos = qoi_decode_fast(bytes, &p, chunks_len, index, &px, &run, pixels, px_len, 3);
+
+  for (; px_pos < px_len; px_pos += channels) {
+    if (run > 0) {
+      run--;
+    }
+    else if (p < chunks_len) {
+      int b1 = bytes[p++];
+
+      if (b1 == QOI_OP_RGB) {
+        if (p + 3 > chunks_len) break;
+        px.rgba.r = bytes[p++];
+        px.rgba.g = bytes[p++];
+        px.rgba.b = bytes[p++];
+      }
+      else if (b1 == QOI_OP_RGBA) {
+        if (p + 4 > chunks_len) break;
+        px.rgba.r = bytes[p++];
+        px.rgba.g = bytes[p++];
+        px.rgba.b = bytes[p++];
+        px.rgba.a = bytes[p++];
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+        px = index[b1];
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+        px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+        px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+        px.rgba.b += ( b1       & 0x03) - 2;
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+        if (p + 1 > chunks_len) break;
+        int b2 = bytes[p++];
+        int vg = (b1 & 0x3f) - 32;
+        px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+        px.rgba.g += vg;
+        px.rgba.b += vg - 8 +  (b2       & 0x0f);
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_RUN) {
+        run = (b1 & 0x3f);
+      }
+
+      index[QOI_COLOR_HASH(px) % 64] = px;
+    }
+
+    pixels[px_pos + 0] = px.rgba.r;
+    pixels[px_pos + 1] = px.rgba.g;
+    pixels[px_pos + 2] = px.rgba.b;
+
+    if (channels == 4) {
+      pixels[px_pos + 3] = px.rgba.a;
+    }
+  }
+
+  memcpy(state->index, index, sizeof(index));
+  state->px = px;
+  state->p = p;
+  state->run = run;
+
+  return px_pos >= px_len;
+}
+
+size_t qoi_decode_partial(qoi_dec_state *state, const void *data, size_t size,
+                          int channels, unsigned char *pixels, size_t n_pixels) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  qoi_rgba_t px = state->px;
+  size_t p = state->p;
+  int run = state->run;
+  size_t px_len = n_pixels * channels, px_pos;
+
+  for (px_pos = 0; px_pos < px_len; px_pos += channels) {
+    if (run > 0) {
+      run--;
+    }
+    else {
+      int b1;
+      size_t len;
+
+      if (p >= size) break;
+      b1 = bytes[p];
+      len = b1 == QOI_OP_RGB ? 4 : b1 == QOI_OP_RGBA ? 5 :
+        (b1 & QOI_MASK_2) == QOI_OP_LUMA ? 2 : 1;
+      if (p + len > size) break;
+      p++;
+
+      if (b1 == QOI_OP_RGB) {
+        px.rgba.r = bytes[p++];
+        px.rgba.g = bytes[p++];
+        px.rgba.b = bytes[p++];
+      }
+      else if (b1 == QOI_OP_RGBA) {
+        px.rgba.r = bytes[p++];
+        px.rgba.g = bytes[p++];
+        px.rgba.b = bytes[p++];
+        px.rgba.a = bytes[p++];
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+        px = state->index[b1];
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+        px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+        px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+        px.rgba.b += ( b1       & 0x03) - 2;
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+        int b2 = bytes[p++];
+        int vg = (b1 & 0x3f) - 32;
+        px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+        px.rgba.g += vg;
+        px.rgba.b += vg - 8 +  (b2       & 0x0f);
+      }
+      else if ((b1 & QOI_MASK_2) == QOI_OP_RUN) {
+        run = (b1 & 0x3f);
+      }
+
+      state->index[QOI_COLOR_HASH(px) % 64] = px;
+    }
+
+    pixels[px_pos + 0] = px.rgba.r;
+    pixels[px_pos + 1] = px.rgba.g;
+    pixels[px_pos + 2] = px.rgba.b;
+
+    if (channels == 4) {
+      pixels[px_pos + 3] = px.rgba.a;
+    }
+  }
+
+  state->px = px;
+  state->p = p;
+  state->run = run;
+
+  return px_pos / channels;
+}
+
+int qoi_decode_pixels(const void *data, size_t size, const qoi_desc *desc,
+                      int channels, unsigned char *pixels) {
+  qoi_dec_state state;
+
+  if (channels == 0) {
+    channels = desc->channels;
+  }
+
+  qoi_decode_init(&state);
+  return qoi_decode_resume(&state, data, size, channels, pixels,
+                           (size_t) desc->width * desc->height);
+}
+
+void *qoi_decode(const void *data, size_t size, qoi_desc *desc, int channels) {
+  unsigned char *pixels;
+
+  if (
+      (channels != 0 && channels != 3 && channels != 4) ||
+        !qoi_decode_header(data, size, desc)
+  ) {
+    return NULL;
+  }
+
+  if (channels == 0) {
+    channels = desc->channels;
+  }
+
+  pixels = (unsigned char *) QOI_MALLOC((size_t) desc->width * desc->height * channels);
+  if (!pixels) {
+    return NULL;
+  }
+
+  if (!qoi_decode_pixels(data, size, desc, channels, pixels)) {
+    QOI_FREE(pixels);
+    return NULL;
+  }
+
+  return pixels;
+}
@@ -0,0 +1,404 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/GraphicsEngine.h>
+#include <R_ext/GraphicsDevice.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qoi.h"
+#include "image.h"
+#include "canvas.h"
+
+/* The graphics device of qoi_device(): plots are drawn into the RGBA pixels
+ of a canvas (see canvas.h), which are encoded straight into a file when the
+ next page begins and when the device is closed. Page i goes to the file
+ named by sprintf(filename, i). Text is drawn with R's Hershey fonts, so it
+ consists of lines like everything else. */
+
+#define QOI_DEVICE_PATH_MAX 4096
+
+typedef struct {
+  qoi_canvas canvas;
+  char filename[QOI_DEVICE_PATH_MAX];  // may hold the page number as %d
+  int page;                            // pages begun so far
+  double res;                          // pixels per inch
+  unsigned char *raster;               // RGBA copy of an image to draw
+  size_t raster_cap;
+} qoi_dev;
+
+static void qoi_dev_rgba(rcolor col, unsigned char *rgba) {
+  rgba[0] = R_RED(col);
+  rgba[1] = R_GREEN(col);
+  rgba[2] = R_BLUE(col);
+  rgba[3] = R_ALPHA(col);
+}
+
+/* -----------------------------------------------------------------------------
+ Pages */
+
+static int qoi_dev_write_file(void *ctx, const unsigned char *bytes, size_t len) {
+  return fwrite(bytes, 1, len, (FILE *) ctx) == len;
+}
+
+/* Encode the current page into its file */
+static void qoi_dev_write(qoi_dev *d) {
+  qoi_desc desc = {(unsigned int) d->canvas.width, (unsigned int) d->canvas.height, 4,
+                   QOI_SRGB};
+  char fn[QOI_DEVICE_PATH_MAX + 32];
+  FILE *f;
+  int ret;
+
+  snprintf(fn, sizeof(fn), d->filename, d->page);
+  f = fopen(fn, "wb");
+  if (!f) {
+    Rf_warning("unable to create %s", fn);
+    return;
+  }
+  ret = qoi_encode_image_stream(d->canvas.pixels, QOI_INPUT_RAW, &desc, NULL,
+                                qoi_dev_write_file, f);
+  if (fclose(f) != 0 || ret != QOI_STREAM_OK)
+    Rf_warning("unable to write %s", fn);
+}
+
+static void qoi_dev_new_page(const pGEcontext gc, pDevDesc dd) {
+  qoi_dev *d = (qoi_dev *) dd->deviceSpecific;
+  unsigned char bg[4];
+
+  if (d->page > 0)
+    qoi_dev_write(d);
+  d->page++;
+  qoi_dev_rgba(gc->fill, bg);
+  qoi_canvas_clear(&d->canvas, bg);
+}
+
+static void qoi_dev_close(pDevDesc dd) {
+  qoi_dev *d = (qoi_dev *) dd->deviceSpecific;
+
+  if (d->page > 0)
+    qoi_dev_write(d);
+  qoi_canvas_free(&d->canvas);
+  free(d->raster);
+  free(d);
+}
+
+static void qoi_dev_size(double *left, double *right, double *bottom, double *top,
+                         pDevDesc dd) {
+  *left = dd->left;
+  *right = dd->right;
+  *bottom = dd->bottom;
+  *top = dd->top;
+}
+
+static void qoi_dev_clip(double x0, double x1, double y0, double y1, pDevDesc dd) {
+  qoi_dev *d = (qoi_dev *) dd->deviceSpecific;
+
+  // the limits are pixels, which are included
+  qoi_canvas_clip(&d->canvas, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1,
+                  (x0 < x1 ? x1 : x0) + 1, (y0 < y1 ? y1 : y0) + 1);
+}
+
+/* The current page as a nativeRaster, see dev.capture() */
+static SEXP qoi_dev_cap(pDevDesc dd) {
+  qoi_dev *d = (qoi_dev *) dd->deviceSpecific;
+  size_t n = (size_t) d->canvas.width * d->canvas.height;
+  const unsigned char *p = d->canvas.pixels;
+  SEXP res = PROTECT(allocMatrix(INTSXP, d->canvas.height, d->canvas.width));
+  int *out = INTEGER(res);
+
+  // row by row, as the dimensions of a nativeRaster have it
+  for (size_t i = 0; i < n; i++, p += 4)
+    out[i] = (int) R_RGBA(p[0], p[1], p[2], p[3]);
+  UNPROTECT(1);
+  return res;
+}
+
+/* -----------------------------------------------------------------------------
+ Shapes */
+
+/* Stroke the line through the n points with the colour and line style of gc */
+static void qoi_dev_stroke(qoi_dev *d, const double *x, const double *y, int n,
+                           int closed, const pGEcontext gc) {
+  double dashes[8];
+  qoi_stroke stroke;
+  unsigned char col[4];
+
+  if (R_TRANSPARENT(gc->col) || gc->lty == LTY_BLANK)
+    return;
+
+  // lwd = 1 is 1/96 inch, but no line is thinner than a pixel
+  stroke.width = gc->lwd * d->res / 96;
+  if (stroke.width < 1)
+    stroke.width = 1;
+  stroke.cap = gc->lend == GE_BUTT_CAP ? QOI_CANVAS_CAP_BUTT :
+    gc->lend == GE_SQUARE_CAP ? QOI_CANVAS_CAP_SQUARE : QOI_CANVAS_CAP_ROUND;
+  stroke.join = gc->ljoin == GE_MITRE_JOIN ? QOI_CANVAS_JOIN_MITRE :
+    gc->ljoin == GE_BEVEL_JOIN ? QOI_CANVAS_JOIN_BEVEL : QOI_CANVAS_JOIN_ROUND;
+  stroke.mitre = gc->lmitre;
+
+  // the dash lengths of lty are hex digits in units of the line width
+  stroke.n_dashes = 0;
+  for (unsigned int lty = (unsigned int) gc->lty; lty & 15 && stroke.n_dashes < 8; lty >>= 4)
+    dashes[stroke.n_dashes++] = (lty & 15) * stroke.width;
+  stroke.dashes = dashes;
+
+  qoi_dev_rgba(gc->col, col);
+  qoi_canvas_stroke(&d->canvas, x, y, n, closed, &stroke);
+  qoi_canvas_fill(&d->canvas, col, 0);
+}
+
+/* Fill and stroke the closed outline through the n points */
+static void qoi_dev_shape(qoi_dev *d, const double *x, const double *y, int n,
+                          const pGEcontext gc) {
+  unsigned char fill[4];
+
+  if (!R_TRANSPARENT(gc->fill)) {
+    qoi_dev_rgba(gc->fill, fill);
+    qoi_canvas_polygon(&d->canvas, x, y, n);
+    qoi_canvas_fill(&d->canvas, fill, 0);
+  }
+  qoi_dev_stroke(d, x, y, n, 1, gc);
+}
+
+static void qoi_dev_line(double x1, double y1, double x2, double y2,
+                         const pGEcontext gc, pDevDesc dd) {
+  double x[2] = {x1, x2}, y[2] = {y1, y2};
+  qoi_dev_stroke((qoi_dev *) dd->deviceSpecific, x, y, 2, 0, gc);
+}
+
+static void qoi_dev_polyline(int n, double *x, double *y, const pGEcontext gc,
+                             pDevDesc dd) {
+  qoi_dev_stroke((qoi_dev *) dd->deviceSpecific, x, y, n, 0, gc);
+}
+
+static void qoi_dev_polygon(int n, double *x, double *y, const pGEcontext gc,
+                            pDevDesc dd) {
+  qoi_dev_shape((qoi_dev *) dd->deviceSpecific, x, y, n, gc);
+}
+
+static void qoi_dev_rect(double x0, double y0, double x1, double y1,
+                         const pGEcontext gc, pDevDesc dd) {
+  double x[4] = {x0, x1, x1, x0}, y[4] = {y0, y0, y1, y1};
+  qoi_dev_shape((qoi_dev *) dd->deviceSpecific, x, y, 4, gc);
+}
+
+static void qoi_dev_circle(double x, double y, double r, const pGEcontext gc,
+                           pDevDesc dd) {
+  double px[QOI_CANVAS_CIRCLE_POINTS], py[QOI_CANVAS_CIRCLE_POINTS];
+  int n = qoi_canvas_circle_points(x, y, r, px, py);
+
+  qoi_dev_shape((qoi_dev *) dd->deviceSpecific, px, py, n, gc);
+}
+
+static void qoi_dev_path(double *x, double *y, int npoly, int *nper, Rboolean winding,
+                         const pGEcontext gc, pDevDesc dd) {
+  qoi_dev *d = (qoi_dev *) dd->deviceSpecific;
+  unsigned char fill[4];
+  int start = 0;
+
+  if (!R_TRANSPARENT(gc->fill)) {
+    qoi_dev_rgba(gc->fill, fill);
+    for (int i = 0; i < npoly; start += nper[i++])
+      qoi_canvas_polygon(&d->canvas, x + start, y + start, nper[i]);
+    qoi_canvas_fill(&d->canvas, fill, !winding);
+  }
+  start = 0;
+  for (int i = 0; i < npoly; start += nper[i++])
+    qoi_dev_stroke(d, x + start, y + start, nper[i], 1, gc);
+}
+
+static void qoi_dev_raster(unsigned int *raster, int w, int h, double x, double y,
+                           double width, double height, double rot,
+                           Rboolean interpolate, const pGEcontext gc, pDevDesc dd) {
+  qoi_dev *d = (qoi_dev *) dd->deviceSpecific;
+  size_t n = (size_t) w * h;
+
+  (void) gc;
+  if (n * 4 > d->raster_cap) {
+    unsigned char *buf = (unsigned char *) realloc(d->raster, n * 4);
+    if (!buf)
+      Rf_error("Malloc error!");
+    d->raster = buf;
+    d->raster_cap = n * 4;
+  }
+  for (size_t i = 0; i < n; i++)
+    qoi_dev_rgba(raster[i], d->raster + 4 * i);
+  qoi_canvas_image(&d->canvas, d->raster, w, h, x, y, width, height, rot, interpolate);
+}
+
+/* -----------------------------------------------------------------------------
+ Text in the Hershey sans serif typeface */
+
+/* The graphics engine's shorthand for a Hershey typeface, as text(vfont = )
+ uses it: the family "Her" followed by the number of the typeface (2 for
+ HersheySans) and the face in Hershey's order (plain, italic, bold) */
+static void qoi_dev_hershey(const pGEcontext gc, R_GE_gcontext *hershey) {
+  *hershey = *gc;
+  memset(hershey->fontfamily, 0, sizeof(hershey->fontfamily));
+  memcpy(hershey->fontfamily, "Her", 3);
+  hershey->fontfamily[3] = 2;
+  switch (gc->fontface) {
+  case 2: hershey->fontface = 3; break;
+  case 3: hershey->fontface = 2; break;
+  case 4: hershey->fontface = 4; break;
+  default: hershey->fontface = 1;
+  }
+}
+
+static double qoi_dev_str_width(const char *str, const pGEcontext gc, pDevDesc dd) {
+  R_GE_gcontext hershey;
+
+  qoi_dev_hershey(gc, &hershey);
+  return R_GE_VStrWidth(str, CE_NATIVE, &hershey, desc2GEDesc(dd));
+}
+
+static void qoi_dev_metric_info(int c, const pGEcontext gc, double *ascent,
+                                double *descent, double *width, pDevDesc dd) {
+  R_GE_gcontext hershey;
+  char str[2] = {'M', '\0'};
+
+  if (c < 0)
+    c = -c;
+  if (c > 0 && c < 256)
+    str[0] = (char) c;
+  qoi_dev_hershey(gc, &hershey);
+  *ascent = R_GE_VStrHeight(str, CE_NATIVE, &hershey, desc2GEDesc(dd));
+  *descent = 0;
+  *width = R_GE_VStrWidth(str, CE_NATIVE, &hershey, desc2GEDesc(dd));
+}
+
+static void qoi_dev_text(double x, double y, const char *str, double rot, double hadj,
+                         const pGEcontext gc, pDevDesc dd) {
+  R_GE_gcontext hershey;
+
+  // the strokes of the glyphs come back through qoi_dev_polyline()
+  qoi_dev_hershey(gc, &hershey);
+  R_GE_VText(x, y, str, CE_NATIVE, hadj, 0, rot, &hershey, desc2GEDesc(dd));
+}
+
+/* -----------------------------------------------------------------------------
+ Opening the device */
+
+/* A file name may contain one integer conversion (%d with flags and width)
+ for the page number, and %% */
+static int qoi_dev_filename_valid(const char *fn) {
+  int conversions = 0;
+
+  for (const char *p = fn; *p; p++) {
+    if (*p != '%')
+      continue;
+    if (*++p == '%')
+      continue;
+    while (*p && strchr("#0- +", *p))
+      p++;
+    while (*p >= '0' && *p <= '9')
+      p++;
+    if (*p != 'd' || ++conversions > 1)
+      return 0;
+  }
+  return 1;
+}
+
+SEXP qoiDevice_(SEXP sFilename, SEXP sWidth, SEXP sHeight, SEXP sPointsize, SEXP sBg,
+                SEXP sRes) {
+  int width = asInteger(sWidth), height = asInteger(sHeight);
+  double ps = asReal(sPointsize), res = asReal(sRes);
+  const char *fn;
+  rcolor bg;
+  qoi_desc desc;
+  qoi_dev *d;
+  pDevDesc dev;
+
+  if (TYPEOF(sFilename) != STRSXP || LENGTH(sFilename) < 1 || STRING_ELT(sFilename, 0) == NA_STRING)
+    Rf_error("invalid filename");
+  fn = CHAR(STRING_ELT(sFilename, 0));
+  if (strlen(fn) >= QOI_DEVICE_PATH_MAX || !qoi_dev_filename_valid(fn))
+    Rf_error("'filename' may contain one integer format such as %%03d for the page number");
+  if (width == NA_INTEGER || width < 1 || height == NA_INTEGER || height < 1)
+    Rf_error("'width' and 'height' must be positive numbers");
+  desc.width = width;
+  desc.height = height;
+  desc.channels = 4;
+  desc.colorspace = QOI_SRGB;
+  if (!qoi_desc_valid(&desc))
+    Rf_error("image dimensions are not supported by the QOI format");
+  if (!R_FINITE(ps) || ps <= 0)
+    Rf_error("'pointsize' must be a positive number");
+  if (!R_FINITE(res) || res <= 0)
+    Rf_error("'res' must be a positive number");
+  bg = RGBpar(sBg, 0);
+
+  R_GE_checkVersionOrDie(R_GE_version);
+  R_CheckDeviceAvailable();
+
+  d = (qoi_dev *) calloc(1, sizeof(qoi_dev));
+  dev = (pDevDesc) calloc(1, sizeof(DevDesc));
+  if (!d || !dev || !qoi_canvas_init(&d->canvas, width, height)) {
+    free(d);
+    free(dev);
+    Rf_error("Malloc error!");
+  }
+  strcpy(d->filename, fn);
+  d->res = res;
+
+  BEGIN_SUSPEND_INTERRUPTS {
+    dev->left = 0;
+    dev->right = width;
+    dev->bottom = height;
+    dev->top = 0;
+    dev->clipLeft = 0;
+    dev->clipRight = width;
+    dev->clipBottom = height;
+    dev->clipTop = 0;
+
+    // character size and placement as for R's bitmap devices
+    dev->xCharOffset = 0.4900;
+    dev->yCharOffset = 0.3333;
+    dev->yLineBias = 0.2;
+    dev->ipr[0] = dev->ipr[1] = 1 / res;
+    dev->cra[0] = 0.9 * ps * res / 72;
+    dev->cra[1] = 1.2 * ps * res / 72;
+    dev->gamma = 1;
+
+    dev->canClip = TRUE;
+    dev->canChangeGamma = FALSE;
+    dev->canHAdj = 2;
+    dev->startps = ps;
+    dev->startcol = R_RGB(0, 0, 0);
+    dev->startfill = bg;
+    dev->startlty = LTY_SOLID;
+    dev->startfont = 1;
+    dev->startgamma = 1;
+    dev->deviceSpecific = d;
+    dev->displayListOn = FALSE;
+
+    dev->close = qoi_dev_close;
+    dev->newPage = qoi_dev_new_page;
+    dev->size = qoi_dev_size;
+    dev->clip = qoi_dev_clip;
+    dev->cap = qoi_dev_cap;
+    dev->line = qoi_dev_line;
+    dev->polyline = qoi_dev_polyline;
+    dev->polygon = qoi_dev_polygon;
+    dev->rect = qoi_dev_rect;
+    dev->circle = qoi_dev_circle;
+    dev->path = qoi_dev_path;
+    dev->raster = qoi_dev_raster;
+    dev->strWidth = qoi_dev_str_width;
+    dev->metricInfo = qoi_dev_metric_info;
+    dev->text = qoi_dev_text;
+
+    dev->hasTextUTF8 = FALSE;
+    dev->wantSymbolUTF8 = FALSE;
+    dev->useRotatedTextInContour = FALSE;
+    dev->haveTransparency = 2;
+    dev->haveTransparentBg = 2;
+    dev->haveRaster = 2;
+    dev->haveCapture = 2;
+    dev->haveLocator = 1;
+
+    GEaddDevice2(GEcreateDevDesc(dev), "qoi_device");
+  } END_SUSPEND_INTERRUPTS;
+
+  return R_NilValue;
+}
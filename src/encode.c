@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <string.h>
+#include "qoi.h"
+#include "scan.h"
+
+int qoi_encode_header(const qoi_desc *desc, unsigned char *bytes) {
+  int p = 0;
+
+  qoi_write_32(bytes, &p, QOI_MAGIC);
+  qoi_write_32(bytes, &p, desc->width);
+  qoi_write_32(bytes, &p, desc->height);
+  bytes[p++] = desc->channels;
+  bytes[p++] = desc->colorspace;
+
+  return p;
+}
+
+void qoi_encode_init(qoi_enc_state *state) {
+  QOI_ZEROARR(state->index);
+
+  state->run = 0;
+  state->px_prev.rgba.r = 0;
+  state->px_prev.rgba.g = 0;
+  state->px_prev.rgba.b = 0;
+  state->px_prev.rgba.a = 255;
+}
+
+/* number of trailing zero bits of a non-zero word */
+static inline int qoi_ctz64(uint64_t v) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(v);
+#else
+  int n = 0;
+  while (!(v & 1)) {
+    v >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/* The pixels are classified by qoi_scan() in blocks of QOI_SCAN_BLOCK (runs,
+ DIFF and LUMA candidates, see scan.h); what is left per pixel is the lookup in
+ the running index, which depends on all pixels before it. The chunks written
+ are the same as those of the reference encoder. */
+size_t qoi_encode_pixels(qoi_enc_state *state, const unsigned char *pixels,
+                         size_t n_pixels, int channels, unsigned char *bytes) {
+  size_t p = 0, px_pos = 0;
+  int run = state->run;
+  qoi_rgba_t *index = state->index;
+  qoi_rgba_t block[QOI_SCAN_BLOCK + 1];
+  qoi_scan_t scan;
+  uint64_t small;
+
+  block[QOI_SCAN_BLOCK] = state->px_prev;
+
+  while (px_pos < n_pixels) {
+    int i, n = n_pixels - px_pos < QOI_SCAN_BLOCK ? (int) (n_pixels - px_pos) : QOI_SCAN_BLOCK;
+    const unsigned char *src = pixels + px_pos * channels;
+
+
+    // block[0] is the last pixel of the previous block
+    block[0] = block[QOI_SCAN_BLOCK];
+    if (channels == 4) {
+      memcpy(block + 1, src, (size_t) n * 4);
+    } else {
+      for (i = 0; i < n; i++) {
+        block[i + 1].rgba.r = src[3 * i + 0];
+        block[i + 1].rgba.g = src[3 * i + 1];
+        block[i + 1].rgba.b = src[3 * i + 2];
+        block[i + 1].rgba.a = block[0].rgba.a;
+      }
+    }
+
+    qoi_scan(block, n, &scan);
+    small = scan.diff | scan.luma;
+
+    for (i = 0; i < n; i++) {
+      qoi_rgba_t px = block[i + 1];
+      int index_pos;
+
+      if (scan.eq >> i & 1) {
+        // bits of eq above n are clear, so the run stops at the block end
+        uint64_t rest = ~scan.eq >> i;
+        int len = rest ? qoi_ctz64(rest) : QOI_SCAN_BLOCK - i;
+
+        run += len;
+        while (run >= 62) {
+          bytes[p++] = QOI_OP_RUN | 61;
+          run -= 62;
+        }
+        i += len - 1;
+        continue;
+      }
+
+      if (run > 0) {
+        bytes[p++] = QOI_OP_RUN | (run - 1);
+        run = 0;
+      }
+
+      index_pos = QOI_PX_HASH(px);
+
+      if (index[index_pos].v == px.v) {
+        bytes[p++] = QOI_OP_INDEX | index_pos;
+      }
+      else {
+        index[index_pos] = px;
+
+        if (small >> i & 1) {
+          // a DIFF chunk leaves the second byte to the next chunk, it stays
+          // within the room of channels + 1 bytes every pixel has
+          bytes[p] = (unsigned char) scan.code[i];
+          bytes[p + 1] = (unsigned char) (scan.code[i] >> 8);
+          p += 1 + (int) (scan.luma >> i & 1);
+        }
+        else if (px.rgba.a == block[i].rgba.a) {
+          bytes[p] = QOI_OP_RGB;
+          memcpy(bytes + p + 1, &px.rgba, 3);
+          p += 4;
+        }
+        else {
+          bytes[p] = QOI_OP_RGBA;
+          memcpy(bytes + p + 1, &px.rgba, 4);
+          p += 5;
+        }
+      }
+    }
+
+    block[QOI_SCAN_BLOCK] = block[n];
+    px_pos += n;
+  }
+
+  state->px_prev = block[QOI_SCAN_BLOCK];
+  state->run = run;
+  return p;
+}
+
+int qoi_encode_restart(qoi_enc_state *state, const unsigned char *pixel,
+                       int channels, unsigned char *bytes) {
+  int i, p = 0;
+  qoi_rgba_t px;
+
+  /* A slot s only ever matches a pixel whose hash is s, so filling every slot
+   with a colour of a different hash means no QOI_OP_INDEX can refer to a
+   colour that was not seen after the restart point. */
+  for (i = 0; i < 64; i++) {
+    state->index[i].v = 0;
+  }
+  state->index[0].rgba.r = 1;
+
+  px.rgba.r = pixel[0];
+  px.rgba.g = pixel[1];
+  px.rgba.b = pixel[2];
+  px.rgba.a = channels == 4 ? pixel[3] : 255;
+
+  if (channels == 4) {
+    bytes[p++] = QOI_OP_RGBA;
+    bytes[p++] = px.rgba.r;
+    bytes[p++] = px.rgba.g;
+    bytes[p++] = px.rgba.b;
+    bytes[p++] = px.rgba.a;
+  } else {
+    bytes[p++] = QOI_OP_RGB;
+    bytes[p++] = px.rgba.r;
+    bytes[p++] = px.rgba.g;
+    bytes[p++] = px.rgba.b;
+  }
+
+  state->index[QOI_PX_HASH(px)] = px;
+  state->px_prev = px;
+  state->run = 0;
+  return p;
+}
+
+int qoi_encode_flush(qoi_enc_state *state, unsigned char *bytes) {
+  int p = 0;
+
+  if (state->run > 0) {
+    bytes[p++] = QOI_OP_RUN | (state->run - 1);
+    state->run = 0;
+  }
+
+  return p;
+}
+
+int qoi_encode_finish(qoi_enc_state *state, unsigned char *bytes) {
+  int i, p = qoi_encode_flush(state, bytes);
+
+  for (i = 0; i < (int)sizeof(qoi_padding); i++) {
+    bytes[p++] = qoi_padding[i];
+  }
+
+  return p;
+}
+
+void *qoi_encode(const void *data, const qoi_desc *desc, size_t *out_len) {
+  size_t max_size, p;
+  unsigned char *bytes;
+  qoi_enc_state state;
+
+  if (
+      data == NULL || out_len == NULL || desc == NULL ||
+        !qoi_desc_valid(desc) ||
+        desc->channels < 3 || desc->channels > 4 ||
+        desc->colorspace > 1
+  ) {
+    return NULL;
+  }
+
+  max_size = qoi_encode_max_size(desc);
+
+  bytes = (unsigned char *) QOI_MALLOC(max_size);
+  if (!bytes) {
+    return NULL;
+  }
+
+  qoi_encode_init(&state);
+  p = qoi_encode_header(desc, bytes);
+  p += qoi_encode_pixels(&state, (const unsigned char *)data,
+                         (size_t) desc->width * desc->height, desc->channels, bytes + p);
+  p += qoi_encode_finish(&state, bytes + p);
+
+  *out_len = p;
+  return bytes;
+}
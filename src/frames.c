@@ -0,0 +1,482 @@
+#include <stdlib.h>
+#include <string.h>
+#include "frames.h"
+#include "image.h"
+#include "mapfile.h"
+#include "trailer.h"
+#include "transpose.h"
+
+static uint32_t get_u32(const unsigned char *bytes) {
+  return (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 |
+    (uint32_t) bytes[2] << 8 | bytes[3];
+}
+
+int qoi_frames_open(const unsigned char *data, size_t size, qoi_frames *frames) {
+  unsigned int param, count;
+  const unsigned char *table;
+  qoi_desc desc;
+
+  if (qoi_trailer_find(data, size, QOI_FRAMES_MAGIC, &param, &count, &table)) {
+    if (param != QOI_FRAMES_VERSION || count == 0)
+      return 0;
+    frames->table = table;
+    frames->count = count;
+    frames->end = (size_t) (table - data);
+    return 1;
+  }
+
+  // a plain QOI image is its only frame
+  if (!qoi_decode_header(data, size, &desc))
+    return 0;
+  frames->table = NULL;
+  frames->count = 1;
+  frames->end = size;
+  return 1;
+}
+
+int qoi_frames_get(const qoi_frames *frames, unsigned int i, size_t *start,
+                   size_t *size) {
+  uint64_t from, to;
+
+  if (i >= frames->count)
+    return 0;
+  if (!frames->table) {
+    *start = 0;
+    *size = frames->end;
+    return 1;
+  }
+
+  from = qoi_trailer_offset(frames->table, i);
+  to = i + 1 < frames->count ? qoi_trailer_offset(frames->table, i + 1) : frames->end;
+  if (from >= to || to > frames->end)
+    return 0;
+
+  *start = (size_t) from;
+  *size = (size_t) (to - from);
+  return 1;
+}
+
+/* Read the header of a delta frame of size bytes into desc and the size of
+ its row bitmap into bitmap_size. Returns 0 if it is not a valid one. */
+static int qoi_delta_header(const unsigned char *frame, size_t size, qoi_desc *desc,
+                            size_t *bitmap_size) {
+  if (size < QOI_DELTA_HEADER_SIZE || memcmp(frame, QOI_DELTA_MAGIC, 4) != 0)
+    return 0;
+
+  desc->width = get_u32(frame + 4);
+  desc->height = get_u32(frame + 8);
+  desc->channels = frame[12];
+  desc->colorspace = frame[13];
+  if (!qoi_desc_valid(desc) || desc->channels < 3 || desc->channels > 4 ||
+      desc->colorspace > 1 || frame[14] != QOI_DELTA_SUB || frame[15] != 0)
+    return 0;
+
+  *bitmap_size = ((size_t) desc->height + 7) / 8;
+  return size - QOI_DELTA_HEADER_SIZE >= *bitmap_size;
+}
+
+static int qoi_is_delta(const unsigned char *frame, size_t size) {
+  return size >= 4 && memcmp(frame, QOI_DELTA_MAGIC, 4) == 0;
+}
+
+int qoi_frames_desc(const unsigned char *data, const qoi_frames *frames,
+                    unsigned int i, qoi_desc *desc) {
+  size_t start, size, bitmap_size;
+
+  if (!qoi_frames_get(frames, i, &start, &size))
+    return 0;
+  if (qoi_is_delta(data + start, size))
+    return qoi_delta_header(data + start, size, desc, &bitmap_size);
+  return qoi_decode_header(data + start, size, desc);
+}
+
+/* Add the differences stored in a delta frame to the interleaved pixels of
+ its reference, which have `channels` bytes per pixel (more than the frame if
+ an alpha channel was added). row is a buffer for one row of the frame. */
+static int qoi_delta_apply(const unsigned char *frame, size_t size, const qoi_desc *desc,
+                           int channels, unsigned char *pixels, unsigned char *row) {
+  const unsigned char *bitmap, *stream;
+  size_t bitmap_size, stream_size, width = desc->width, stride;
+  unsigned int changed = 0;
+  qoi_desc delta, diff;
+  qoi_dec_state state;
+
+  if (!qoi_delta_header(frame, size, &delta, &bitmap_size) ||
+      delta.width != desc->width || delta.height != desc->height ||
+      delta.channels != desc->channels)
+    return 0;
+
+  bitmap = frame + QOI_DELTA_HEADER_SIZE;
+  for (size_t b = 0; b < bitmap_size; b++)
+    for (unsigned int bits = bitmap[b]; bits; bits &= bits - 1)
+      changed++;
+  if (changed == 0)
+    return 1;
+
+  stream = bitmap + bitmap_size;
+  stream_size = size - QOI_DELTA_HEADER_SIZE - bitmap_size;
+  if (!qoi_decode_header(stream, stream_size, &diff) || diff.width != desc->width ||
+      diff.height != changed || diff.channels != desc->channels)
+    return 0;
+
+  qoi_decode_init(&state);
+  stride = width * desc->channels;
+  for (unsigned int y = 0; y < desc->height; y++) {
+    unsigned char *dst = pixels + (size_t) y * width * channels;
+
+    if (!(bitmap[y >> 3] & (0x80 >> (y & 7))))
+      continue;
+    if (!qoi_decode_resume(&state, stream, stream_size, desc->channels, row, width))
+      return 0;
+
+    if (channels == desc->channels) {
+      for (size_t k = 0; k < stride; k++)
+        dst[k] += row[k];
+    } else {
+      for (size_t x = 0; x < width; x++)
+        for (int c = 0; c < desc->channels; c++)
+          dst[x * channels + c] += row[x * desc->channels + c];
+    }
+  }
+  return 1;
+}
+
+int qoi_frames_decode(const unsigned char *data, const qoi_frames *frames,
+                      unsigned int i, const qoi_desc *desc, int format,
+                      void *out) {
+  size_t start, size, n = (size_t) desc->width * desc->height;
+  int channels = format == QOI_FORMAT_NATIVE_RASTER ? 4 : desc->channels;
+  unsigned int key = i;
+  unsigned char *pixels, *row;
+  qoi_desc key_desc;
+  int ok;
+
+  if (!qoi_frames_get(frames, i, &start, &size))
+    return 0;
+  if (!qoi_is_delta(data + start, size))
+    return qoi_decode_image(data + start, size, desc, format, out);
+
+  // the closest key frame before, which has to match the delta frames
+  do {
+    if (key == 0 || !qoi_frames_get(frames, --key, &start, &size))
+      return 0;
+  } while (qoi_is_delta(data + start, size));
+  if (!qoi_decode_header(data + start, size, &key_desc) ||
+      key_desc.width != desc->width || key_desc.height != desc->height ||
+      key_desc.channels != desc->channels)
+    return 0;
+
+  // raw arrays and native rasters are reconstructed in place
+  pixels = format == QOI_FORMAT_ARRAY ?
+    (unsigned char *) QOI_MALLOC(n * channels) : (unsigned char *) out;
+  row = (unsigned char *) QOI_MALLOC((size_t) desc->width * desc->channels);
+  ok = pixels && row && qoi_decode_pixels(data + start, size, desc, channels, pixels);
+
+  while (ok && key++ < i) {
+    ok = qoi_frames_get(frames, key, &start, &size) &&
+      qoi_delta_apply(data + start, size, desc, channels, pixels, row);
+  }
+
+  if (ok && format == QOI_FORMAT_ARRAY)
+    qoi_planar_from_interleaved(pixels, (int *) out, desc->width, desc->height,
+                                channels, 0, desc->height);
+  if (ok && format == QOI_FORMAT_NATIVE_RASTER)
+    qoi_native_raster_order((unsigned int *) out, n);
+
+  if (pixels && pixels != out)
+    QOI_FREE(pixels);
+  if (row)
+    QOI_FREE(row);
+  return ok;
+}
+
+static int qoi_frames_reserve(qoi_frames_writer *w, unsigned int n) {
+  uint64_t *offsets;
+  unsigned int cap;
+
+  if (n <= w->cap)
+    return 1;
+  cap = w->cap ? w->cap : 64;
+  while (cap < n)
+    cap = cap > UINT_MAX / 2 ? UINT_MAX : cap * 2;
+
+  offsets = (uint64_t *) realloc(w->offsets, (size_t) cap * sizeof(uint64_t));
+  if (!offsets)
+    return 0;
+  w->offsets = offsets;
+  w->cap = cap;
+  return 1;
+}
+
+/* Read the frame table of the file being appended to and position the file
+ behind the last frame, where the new frames overwrite the old table. The
+ table is kept to restore the file if the append fails. */
+static int qoi_frames_load(qoi_frames_writer *w) {
+  unsigned char footer[QOI_TRAILER_FOOTER_SIZE], head[QOI_HEADER_SIZE];
+  int64_t size, end;
+  qoi_desc desc;
+  FILE *f = w->f;
+
+  if (qoi_fseek(f, 0, SEEK_END) != 0 || (size = qoi_ftell(f)) < 0)
+    return QOI_FRAMES_EOPEN;
+  if (size == 0)
+    return QOI_FRAMES_OK;
+
+  if (size >= QOI_TRAILER_FOOTER_SIZE &&
+      qoi_fseek(f, size - QOI_TRAILER_FOOTER_SIZE, SEEK_SET) == 0 &&
+      fread(footer, 1, sizeof(footer), f) == sizeof(footer) &&
+      memcmp(footer + 8, QOI_FRAMES_MAGIC, 4) == 0) {
+    unsigned int param, count = get_u32(footer + 4);
+    size_t table_size = qoi_trailer_size(count);
+    const unsigned char *table;
+    unsigned char *buf;
+
+    if (get_u32(footer) != QOI_FRAMES_VERSION || count == 0 ||
+        (uint64_t) table_size > (uint64_t) size)
+      return QOI_FRAMES_EFORMAT;
+    if (!qoi_frames_reserve(w, count) || !(buf = (unsigned char *) malloc(table_size)))
+      return QOI_FRAMES_EALLOC;
+
+    end = size - (int64_t) table_size;
+    if (qoi_fseek(f, end, SEEK_SET) != 0 || fread(buf, 1, table_size, f) != table_size ||
+        !qoi_trailer_find(buf, table_size, QOI_FRAMES_MAGIC, &param, &count, &table)) {
+      free(buf);
+      return QOI_FRAMES_EFORMAT;
+    }
+    for (unsigned int i = 0; i < count; i++)
+      w->offsets[i] = qoi_trailer_offset(table, i);
+    w->count = count;
+    w->old_table = buf;
+    w->old_table_size = table_size;
+  } else {
+    // a plain QOI image becomes the first frame; the header check only needs
+    // the size to admit the shortest possible stream
+    if (size < QOI_HEADER_SIZE + (int64_t) sizeof(qoi_padding) ||
+        qoi_fseek(f, 0, SEEK_SET) != 0 || fread(head, 1, sizeof(head), f) != sizeof(head) ||
+        !qoi_decode_header(head, QOI_HEADER_SIZE + sizeof(qoi_padding), &desc))
+      return QOI_FRAMES_EFORMAT;
+    if (!qoi_frames_reserve(w, 1))
+      return QOI_FRAMES_EALLOC;
+    w->offsets[0] = 0;
+    w->count = 1;
+    end = size;
+  }
+
+  w->appending = 1;
+  w->old_end = end;
+  w->old_size = size;
+  return qoi_fseek(f, end, SEEK_SET) == 0 ? QOI_FRAMES_OK : QOI_FRAMES_EOPEN;
+}
+
+/* Undo a failed append: the bytes in front of old_end were not touched, so
+ writing the old table back and cutting off the rest restores the file. Its
+ old blocks are still allocated, so this works on a full disk as well. */
+static void qoi_frames_restore(qoi_frames_writer *w) {
+  if (qoi_fseek(w->f, w->old_end, SEEK_SET) != 0)
+    return;
+  if (w->old_table_size &&
+      fwrite(w->old_table, 1, w->old_table_size, w->f) != w->old_table_size)
+    return;
+  qoi_ftruncate(w->f, w->old_size);
+}
+
+int qoi_frames_begin(qoi_frames_writer *w, const char *filename, int append,
+                     unsigned int keyframe) {
+  memset(w, 0, sizeof(*w));
+  w->keyframe = keyframe;
+
+  if (append) {
+    w->f = fopen(filename, "r+b");
+    // an existing file which cannot be updated must not be truncated below
+    if (!w->f && (w->f = fopen(filename, "rb")) != NULL) {
+      fclose(w->f);
+      w->f = NULL;
+      return w->status = QOI_FRAMES_EOPEN;
+    }
+    // unbuffered, so a failed write shows at once and leaves nothing pending
+    // that would keep qoi_frames_restore() from seeking; the encoder writes
+    // in large blocks anyway
+    if (w->f)
+      setvbuf(w->f, NULL, _IONBF, 0);
+  }
+  if (!w->f) {
+    append = 0;
+    w->f = fopen(filename, "wb");
+  }
+  if (!w->f)
+    return w->status = QOI_FRAMES_EOPEN;
+
+  w->status = append ? qoi_frames_load(w) : QOI_FRAMES_OK;
+  return w->status;
+}
+
+static int qoi_frames_write(void *ctx, const unsigned char *bytes, size_t len) {
+  return fwrite(bytes, 1, len, (FILE *) ctx) == len;
+}
+
+static int qoi_frames_status(int ret) {
+  if (ret == QOI_STREAM_OK)
+    return QOI_FRAMES_OK;
+  return ret == QOI_STREAM_EALLOC ? QOI_FRAMES_EALLOC : QOI_FRAMES_EWRITE;
+}
+
+/* Write the interleaved pixels as a delta frame against w->ref. The
+ differences of the changed rows are gathered at the front of the reference,
+ which is no longer needed once its row has been compared, and encoded from
+ there, so no buffer besides the bitmap is needed. */
+static int qoi_frames_put_delta(qoi_frames_writer *w, const unsigned char *pixels,
+                                const qoi_desc *desc) {
+  size_t stride = (size_t) desc->width * desc->channels;
+  size_t bitmap_size = ((size_t) desc->height + 7) / 8;
+  unsigned char *header, *bitmap, *ref = w->ref.bytes;
+  unsigned int changed = 0;
+  int p = 4, ret = QOI_FRAMES_OK;
+
+  header = (unsigned char *) calloc(QOI_DELTA_HEADER_SIZE + bitmap_size, 1);
+  if (!header)
+    return QOI_FRAMES_EALLOC;
+  memcpy(header, QOI_DELTA_MAGIC, 4);
+  qoi_write_32(header, &p, desc->width);
+  qoi_write_32(header, &p, desc->height);
+  header[12] = desc->channels;
+  header[13] = desc->colorspace;
+  header[14] = QOI_DELTA_SUB;
+  bitmap = header + QOI_DELTA_HEADER_SIZE;
+
+  w->has_ref = 0;
+  for (unsigned int y = 0; y < desc->height; y++) {
+    const unsigned char *src = pixels + y * stride, *old = ref + y * stride;
+    unsigned char *diff = ref + (size_t) changed * stride;
+
+    if (memcmp(src, old, stride) == 0)
+      continue;
+    bitmap[y >> 3] |= 0x80 >> (y & 7);
+    for (size_t k = 0; k < stride; k++)
+      diff[k] = src[k] - old[k];
+    changed++;
+  }
+
+  if (fwrite(header, 1, QOI_DELTA_HEADER_SIZE + bitmap_size, w->f) !=
+      QOI_DELTA_HEADER_SIZE + bitmap_size) {
+    ret = QOI_FRAMES_EWRITE;
+  } else if (changed > 0) {
+    qoi_desc diff_desc = *desc;
+
+    diff_desc.height = changed;
+    ret = qoi_frames_status(qoi_encode_image_stream(ref, QOI_INPUT_RAW, &diff_desc, NULL,
+                                                    qoi_frames_write, w->f));
+  }
+  free(header);
+  return ret;
+}
+
+/* Write a frame as a key or a delta frame and keep it as the reference of
+ the next one */
+static int qoi_frames_put_keyed(qoi_frames_writer *w, const void *data, int input,
+                                const qoi_desc *desc) {
+  size_t size = (size_t) desc->width * desc->height * desc->channels;
+  const unsigned char *pixels = (const unsigned char *) data;
+  int delta, ret;
+
+  delta = w->has_ref && w->deltas + 1 < w->keyframe &&
+    w->ref_desc.width == desc->width && w->ref_desc.height == desc->height &&
+    w->ref_desc.channels == desc->channels;
+
+  // the whole frame is needed as reference, so the planar layout is converted
+  // in one go instead of band by band
+  if (input != QOI_INPUT_RAW) {
+    unsigned char *cur = qoi_buffer_take(&w->cur, size);
+
+    if (!cur)
+      return QOI_FRAMES_EALLOC;
+    qoi_interleave_rows(data, input, desc, cur, 0, desc->height, NULL);
+    pixels = cur;
+  }
+
+  if (delta) {
+    ret = qoi_frames_put_delta(w, pixels, desc);
+    w->deltas++;
+  } else {
+    ret = qoi_frames_status(qoi_encode_image_stream(pixels, QOI_INPUT_RAW, desc, NULL,
+                                                    qoi_frames_write, w->f));
+    w->deltas = 0;
+  }
+  if (ret != QOI_FRAMES_OK)
+    return ret;
+
+  if (input != QOI_INPUT_RAW) {
+    qoi_buffer tmp = w->ref;
+
+    w->ref = w->cur;
+    w->cur = tmp;
+  } else {
+    unsigned char *ref = qoi_buffer_take(&w->ref, size);
+
+    if (!ref)
+      return QOI_FRAMES_EALLOC;
+    memcpy(ref, pixels, size);
+  }
+  w->ref_desc = *desc;
+  w->has_ref = 1;
+  return QOI_FRAMES_OK;
+}
+
+int qoi_frames_add(qoi_frames_writer *w, const void *data, int input,
+                   const qoi_desc *desc) {
+  int64_t pos;
+  int ret;
+
+  if (w->status != QOI_FRAMES_OK)
+    return w->status;
+  if (w->count == UINT_MAX || !qoi_frames_reserve(w, w->count + 1))
+    return w->status = QOI_FRAMES_EALLOC;
+  if ((pos = qoi_ftell(w->f)) < 0)
+    return w->status = QOI_FRAMES_EWRITE;
+
+  if (w->keyframe > 1)
+    ret = qoi_frames_put_keyed(w, data, input, desc);
+  else
+    ret = qoi_frames_status(qoi_encode_image_stream(data, input, desc, NULL,
+                                                    qoi_frames_write, w->f));
+  if (ret != QOI_FRAMES_OK)
+    return w->status = ret;
+
+  w->offsets[w->count++] = (uint64_t) pos;
+  return QOI_FRAMES_OK;
+}
+
+int qoi_frames_end(qoi_frames_writer *w) {
+  if (w->status == QOI_FRAMES_OK && w->count > 0) {
+    size_t size = qoi_trailer_size(w->count);
+    unsigned char *trailer = (unsigned char *) malloc(size);
+
+    if (!trailer) {
+      w->status = QOI_FRAMES_EALLOC;
+    } else {
+      qoi_trailer_write(trailer, QOI_FRAMES_MAGIC, QOI_FRAMES_VERSION, w->offsets, w->count);
+      if (fwrite(trailer, 1, size, w->f) != size)
+        w->status = QOI_FRAMES_EWRITE;
+      free(trailer);
+    }
+  }
+
+  // buffered writes may only fail here, e.g. on a full disk
+  if (w->f && w->status == QOI_FRAMES_OK && fflush(w->f) != 0)
+    w->status = QOI_FRAMES_EWRITE;
+  if (w->f && w->appending && w->status != QOI_FRAMES_OK)
+    qoi_frames_restore(w);
+  if (w->f && fclose(w->f) != 0 && w->status == QOI_FRAMES_OK)
+    w->status = QOI_FRAMES_EWRITE;
+  free(w->offsets);
+  free(w->old_table);
+  w->old_table = NULL;
+  w->old_table_size = 0;
+  w->appending = 0;
+  qoi_buffer_free(&w->ref);
+  qoi_buffer_free(&w->cur);
+  w->has_ref = 0;
+  w->f = NULL;
+  w->offsets = NULL;
+  w->count = w->cap = 0;
+  return w->status;
+}
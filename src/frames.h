@@ -0,0 +1,115 @@
+#ifndef QOI_FRAMES_H
+#define QOI_FRAMES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "qoi.h"
+#include "buffer.h"
+
+/* Multi-frame container: the QOI streams of the frames one after the other,
+ each complete with header and end marker, followed by a trailer (see
+ trailer.h) with the magic QOI_FRAMES_MAGIC that records the byte offset of
+ every frame; its parameter is QOI_FRAMES_VERSION. The first frame starts at
+ offset 0, so any QOI decoder reads a container as its first frame. Frame i
+ ends where frame i + 1 begins, the last one where the trailer begins.
+
+ A plain QOI file (without the trailer) is a container of one frame. */
+#define QOI_FRAMES_MAGIC "qoiF"
+#define QOI_FRAMES_VERSION 1
+
+/* A frame is either a key frame, a plain QOI stream, or a delta frame which
+ only records how it differs from the frame before it. Delta frames start with
+ their own header, so that no QOI decoder takes them for an image:
+
+   "qoiD" | width (u32) | height (u32) | channels | colorspace | mode | 0
+
+ followed by a bitmap of height bits (most significant bit first, padded to
+ whole bytes) in which a set bit marks a row that differs from the reference,
+ and, unless no row differs, a complete QOI stream of width x (number of such
+ rows) pixels with the given channels. Its pixels hold the differences of the
+ changed rows, for mode QOI_DELTA_SUB the bytes of the frame minus those of
+ the reference modulo 256, so unchanged pixels within a changed row become
+ runs of zeros. Unchanged rows take one bit. A delta frame must have the size
+ and channels of the frame before it; the first frame is a key frame. */
+#define QOI_DELTA_MAGIC "qoiD"
+#define QOI_DELTA_HEADER_SIZE 16
+#define QOI_DELTA_SUB 1
+
+#define QOI_FRAMES_OK       0
+#define QOI_FRAMES_EOPEN   -1
+#define QOI_FRAMES_EFORMAT -2
+#define QOI_FRAMES_EWRITE  -3
+#define QOI_FRAMES_EALLOC  -4
+
+/* Frame table of a container held in memory (e.g. memory-mapped) */
+typedef struct {
+  const unsigned char *table; // offset table, NULL for a plain QOI file
+  unsigned int count;
+  size_t end;                 // start of the trailer
+} qoi_frames;
+
+/* Find the frame table at the end of the size bytes of data. Only the
+ trailer is read, so this costs the same for any number of frames. Returns
+ 0 if data is neither a container nor a QOI image. */
+int qoi_frames_open(const unsigned char *data, size_t size, qoi_frames *frames);
+
+/* Byte offset and size of frame i (0-based). Returns 0 if i is out of range
+ or the offsets of the frame are inconsistent. */
+int qoi_frames_get(const qoi_frames *frames, unsigned int i, size_t *start,
+                   size_t *size);
+
+/* Read the size and channels of frame i, a key or a delta frame, into desc.
+ Returns 0 if the frame is corrupt. */
+int qoi_frames_desc(const unsigned char *data, const qoi_frames *frames,
+                    unsigned int i, qoi_desc *desc);
+
+/* Decode frame i, whose description was read by qoi_frames_desc(), into
+ `out` in the given format (see image.h). A delta frame is reconstructed from
+ the closest key frame before it, so the cost grows with the distance to it.
+ Returns 0 on corrupt data or if a buffer could not be allocated. */
+int qoi_frames_decode(const unsigned char *data, const qoi_frames *frames,
+                      unsigned int i, const qoi_desc *desc, int format,
+                      void *out);
+
+/* Writes frames to a file: qoi_frames_begin() creates the file or, with
+ append set, positions behind the last frame of an existing container (or
+ QOI image), then qoi_frames_add() encodes one frame after the other straight
+ into the file and qoi_frames_end() writes the frame table over the old one
+ and closes the file. Each returns QOI_FRAMES_OK or one of the errors above;
+ after an error only qoi_frames_end() may be called, which then just closes
+ the file and returns the first error. A failed append is rolled back: the
+ old frame table is written back and the file cut to its old size, so the
+ container stays as it was.
+
+ With keyframe > 1 a frame of the same size and channels as the one added
+ before it is stored as a delta frame, except for every keyframe-th frame,
+ which bounds the number of delta frames a reader has to apply. The first
+ frame added is always a key frame. The writer then keeps the interleaved
+ pixels of the last frame as the reference. */
+typedef struct {
+  FILE *f;
+  uint64_t *offsets;
+  unsigned int count;
+  unsigned int cap;
+  int status;
+  unsigned int keyframe;  // key frame interval, 0 or 1 for key frames only
+  unsigned int deltas;    // delta frames since the last key frame
+  int has_ref;            // ref holds the last frame, described by ref_desc
+  qoi_desc ref_desc;
+  qoi_buffer ref;
+  qoi_buffer cur;         // interleaved copy of a planar frame
+  int appending;          // the file existed, see qoi_frames_restore()
+  int64_t old_end;        // where the new frames start
+  int64_t old_size;
+  unsigned char *old_table; // the trailer from old_end on, if any
+  size_t old_table_size;
+} qoi_frames_writer;
+
+int qoi_frames_begin(qoi_frames_writer *w, const char *filename, int append,
+                     unsigned int keyframe);
+int qoi_frames_add(qoi_frames_writer *w, const void *data, int input,
+                   const qoi_desc *desc);
+int qoi_frames_end(qoi_frames_writer *w);
+
+#endif // QOI_FRAMES_H
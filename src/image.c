@@ -0,0 +1,583 @@
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+#include "seek.h"
+#include "trailer.h"
+#include "transpose.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define QOI_X86_SIMD 1
+#include <emmintrin.h>
+#endif
+
+/* number of pixels converted from R's planar layout per band; the interleaved
+ scratch buffer never exceeds QOI_BAND_PIXELS * 4 bytes unless the image is
+ wider than QOI_BAND_PIXELS / QOI_BAND_MIN_ROWS pixels. Bands are at least
+ QOI_BAND_MIN_ROWS rows high so every cache line read from the planes is used
+ completely */
+#define QOI_BAND_PIXELS 65536
+#define QOI_BAND_MIN_ROWS 16
+
+/* a streaming encoder passes its block on once fewer than this many pixels
+ fit into the rest of it in the worst case */
+#define QOI_BLOCK_MIN_PIXELS 256
+
+/* Row buffer for seeking and cropping (see seek.h), large enough for either.
+ A region of whole rows from the first one on needs none: *row is left NULL
+ then and 1 is returned. Returns 0 if the buffer could not be allocated. */
+static int qoi_take_row(const qoi_desc *desc, int y0, int w, qoi_context *ctx,
+                        unsigned char **row) {
+  *row = NULL;
+  if (y0 == 0 && w == (int) desc->width)
+    return 1;
+  *row = qoi_buffer_take(ctx ? &ctx->row : NULL, (size_t) desc->width * 4);
+  return *row != NULL;
+}
+
+/* Decode the region into interleaved pixels: the whole image is decoded in one
+ go, anything smaller row by row, starting from the closest checkpoint */
+static int qoi_decode_interleaved(const void *data, size_t size, const qoi_desc *desc,
+                                  const unsigned char *index, int x0, int y0,
+                                  int w, int h, int channels, unsigned char *out,
+                                  qoi_context *ctx) {
+  unsigned char *row;
+  qoi_dec_state state;
+  int ok;
+
+  if (w == (int) desc->width && h == (int) desc->height)
+    return qoi_decode_pixels(data, size, desc, channels, out);
+
+  if (!qoi_take_row(desc, y0, w, ctx, &row))
+    return 0;
+  ok = qoi_decode_seek(data, size, desc, index, y0, row, &state) &&
+    qoi_decode_rows(&state, data, size, desc, x0, w, h, channels, row, out);
+  qoi_buffer_release(ctx ? &ctx->row : NULL, row);
+  return ok;
+}
+
+/* Decode the region into R's planar layout one band of rows at a time, so the
+ interleaved scratch buffer stays small however large the image is */
+static int qoi_decode_planar(const void *data, size_t size, const qoi_desc *desc,
+                             const unsigned char *index, int x0, int y0,
+                             int w, int h, int *out, qoi_context *ctx) {
+  int channels = desc->channels;
+  unsigned char *scratch, *row;
+  qoi_dec_state state;
+  int band_rows, ok = 1;
+
+  band_rows = QOI_BAND_PIXELS / w;
+  if (band_rows < QOI_BAND_MIN_ROWS) band_rows = QOI_BAND_MIN_ROWS;
+  if (band_rows > h) band_rows = h;
+
+  scratch = qoi_buffer_take(ctx ? &ctx->scratch : NULL, (size_t) band_rows * w * channels);
+  if (!qoi_take_row(desc, y0, w, ctx, &row) || !scratch) {
+    qoi_buffer_release(ctx ? &ctx->scratch : NULL, scratch);
+    qoi_buffer_release(ctx ? &ctx->row : NULL, row);
+    return 0;
+  }
+
+  ok = qoi_decode_seek(data, size, desc, index, y0, row, &state);
+  for (int y = 0; y < h && ok; y += band_rows) {
+    int rows = h - y < band_rows ? h - y : band_rows;
+
+    ok = qoi_decode_rows(&state, data, size, desc, x0, w, rows, channels, row, scratch);
+    if (ok)
+      qoi_planar_from_interleaved(scratch, out, w, h, channels, y, rows);
+  }
+
+  qoi_buffer_release(ctx ? &ctx->scratch : NULL, scratch);
+  qoi_buffer_release(ctx ? &ctx->row : NULL, row);
+  return ok;
+}
+
+void qoi_native_raster_order(unsigned int *packed, size_t n) {
+  const unsigned int one = 1;
+
+  // R_RGBA() keeps red in the lowest byte, which is the decoded byte order
+  // on little-endian machines only
+  if (*(const unsigned char *) &one == 0) {
+    for (size_t i = 0; i < n; i++) {
+      unsigned int v = packed[i];
+      packed[i] = v >> 24 | (v >> 8 & 0xff00) | (v << 8 & 0xff0000) | v << 24;
+    }
+  }
+}
+
+int qoi_decode_image_region(const void *data, size_t size, const qoi_desc *desc,
+                            const unsigned char *index, int x0, int y0,
+                            int w, int h, int format, void *out,
+                            qoi_context *ctx) {
+  int channels = desc->channels;
+
+  switch (format) {
+  case QOI_FORMAT_RAW:
+    return qoi_decode_interleaved(data, size, desc, index, x0, y0, w, h,
+                                  channels, (unsigned char *) out, ctx);
+
+  case QOI_FORMAT_NATIVE_RASTER:
+    if (!qoi_decode_interleaved(data, size, desc, index, x0, y0, w, h,
+                                4, (unsigned char *) out, ctx))
+      return 0;
+    qoi_native_raster_order((unsigned int *) out, (size_t) h * w);
+    return 1;
+
+  default:
+    return qoi_decode_planar(data, size, desc, index, x0, y0, w, h, (int *) out, ctx);
+  }
+}
+
+int qoi_decode_image(const void *data, size_t size, const qoi_desc *desc,
+                     int format, void *out) {
+  return qoi_decode_image_region(data, size, desc, NULL, 0, 0,
+                                 desc->width, desc->height, format, out, NULL);
+}
+
+/* Add a row of n bytes to 16-bit column sums, which hold up to 257 rows */
+static void qoi_add_row(uint16_t *cols, const unsigned char *row, size_t n) {
+  size_t k = 0;
+
+#ifdef QOI_X86_SIMD
+  const __m128i zero = _mm_setzero_si128();
+
+  for (; k + 16 <= n; k += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (row + k));
+    __m128i lo = _mm_loadu_si128((const __m128i *) (cols + k));
+    __m128i hi = _mm_loadu_si128((const __m128i *) (cols + k + 8));
+    _mm_storeu_si128((__m128i *) (cols + k), _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero)));
+    _mm_storeu_si128((__m128i *) (cols + k + 8), _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero)));
+  }
+#endif
+  for (; k < n; k++)
+    cols[k] += row[k];
+}
+
+/* Sum up the column sums of `count` rows over boxes of `scale` columns and
+ store their rounded means as row y of the scaled image. Inlined for 3 and 4
+ channels, so the per-channel loops are unrolled. */
+QOI_INLINE void qoi_scaled_row_n(const uint16_t *cols, size_t width, int scale,
+                                 int count, int channels, int format, size_t y,
+                                 size_t out_w, size_t out_h, void *out) {
+  unsigned int full = (unsigned int) (scale * count), shift = 0;
+
+  // full boxes of the usual power of two factors need no division
+  if ((full & (full - 1)) == 0)
+    while ((1u << shift) < full)
+      shift++;
+
+  for (size_t x = 0; x < out_w; x++) {
+    size_t box_w = width - x * scale < (size_t) scale ? width - x * scale : (size_t) scale;
+    unsigned int n = (unsigned int) (box_w * count), sum[4] = {0, 0, 0, 0};
+    const uint16_t *col = cols + x * scale * channels;
+
+    for (size_t k = 0; k < box_w; k++, col += channels)
+      for (int c = 0; c < channels; c++)
+        sum[c] += col[c];
+
+    for (int c = 0; c < channels; c++)
+      sum[c] = n == full && shift ? (sum[c] + n / 2) >> shift : (sum[c] + n / 2) / n;
+
+    if (format == QOI_FORMAT_ARRAY) {
+      int *dst = (int *) out + x * out_h + y;
+      for (int c = 0; c < channels; c++)
+        dst[c * out_w * out_h] = (int) sum[c];
+    } else {
+      unsigned char *dst = (unsigned char *) out + (y * out_w + x) * channels;
+      for (int c = 0; c < channels; c++)
+        dst[c] = (unsigned char) sum[c];
+    }
+  }
+}
+
+static void qoi_scaled_row(const uint16_t *cols, size_t width, int scale, int count,
+                           int channels, int format, size_t y, size_t out_w,
+                           size_t out_h, void *out) {
+  if (channels == 4)
+    qoi_scaled_row_n(cols, width, scale, count, 4, format, y, out_w, out_h, out);
+  else
+    qoi_scaled_row_n(cols, width, scale, count, 3, format, y, out_w, out_h, out);
+}
+
+int qoi_decode_image_scaled(const void *data, size_t size, const qoi_desc *desc,
+                            int scale, int format, void *out) {
+  size_t width = desc->width, height = desc->height;
+  size_t out_w = (width + scale - 1) / scale, out_h = (height + scale - 1) / scale;
+  size_t stride;
+  int channels = format == QOI_FORMAT_NATIVE_RASTER ? 4 : desc->channels;
+  unsigned char *row;
+  uint16_t *cols;
+  qoi_dec_state state;
+  size_t y_out = 0;
+  int ok = 1, count = 0;
+
+  if (scale < 1 || scale > QOI_SCALE_MAX)
+    return 0;
+
+  // every decoded row is added to the column sums; the boxes are only summed
+  // up once per output row
+  stride = width * channels;
+  row = (unsigned char *) QOI_MALLOC(stride);
+  cols = (uint16_t *) calloc(stride, sizeof(uint16_t));
+  if (!row || !cols) {
+    if (row) QOI_FREE(row);
+    free(cols);
+    return 0;
+  }
+
+  qoi_decode_init(&state);
+  for (size_t y = 0; y < height && ok; y++) {
+    ok = qoi_decode_resume(&state, data, size, channels, row, width);
+    if (!ok)
+      break;
+
+    qoi_add_row(cols, row, stride);
+    if (++count == scale || y == height - 1) {
+      qoi_scaled_row(cols, width, scale, count, channels, format, y_out++, out_w, out_h, out);
+      memset(cols, 0, stride * sizeof(uint16_t));
+      count = 0;
+    }
+  }
+
+  if (ok && format == QOI_FORMAT_NATIVE_RASTER)
+    qoi_native_raster_order((unsigned int *) out, out_w * out_h);
+
+  QOI_FREE(row);
+  free(cols);
+  return ok;
+}
+
+int qoi_decode_image_nchw(const void *data, size_t size, const qoi_desc *desc,
+                          int *out, size_t n, size_t count) {
+  size_t width = desc->width, height = desc->height, channels = desc->channels;
+  size_t row_stride = count * channels, col_stride = row_stride * height;
+  unsigned char *scratch;
+  qoi_dec_state state;
+  size_t band_rows;
+  int ok = 1;
+
+  band_rows = QOI_BAND_PIXELS / width;
+  if (band_rows < QOI_BAND_MIN_ROWS) band_rows = QOI_BAND_MIN_ROWS;
+  if (band_rows > height) band_rows = height;
+
+  scratch = (unsigned char *) QOI_MALLOC(band_rows * width * channels);
+  if (!scratch)
+    return 0;
+
+  qoi_decode_init(&state);
+  for (size_t y = 0; y < height && ok; y += band_rows) {
+    size_t rows = height - y < band_rows ? height - y : band_rows;
+
+    ok = qoi_decode_resume(&state, data, size, channels, scratch, rows * width);
+    if (!ok)
+      break;
+
+    // column by column, so the writes of a band stay close together
+    for (size_t x = 0; x < width; x++) {
+      const unsigned char *src = scratch + x * channels;
+      int *dst = out + n + x * col_stride + y * row_stride;
+
+      for (size_t r = 0; r < rows; r++)
+        for (size_t c = 0; c < channels; c++)
+          dst[r * row_stride + c * count] = src[r * width * channels + c];
+    }
+  }
+
+  QOI_FREE(scratch);
+  return ok;
+}
+
+void qoi_context_free(qoi_context *ctx) {
+  qoi_buffer_free(&ctx->input);
+  qoi_buffer_free(&ctx->scratch);
+  qoi_buffer_free(&ctx->row);
+  qoi_buffer_free(&ctx->output);
+}
+
+/* Output of qoi_encode_rows(): a buffer of cap bytes which is either large
+ enough for everything (write == NULL) or passed on to write whenever it is
+ full */
+typedef struct {
+  unsigned char *bytes;
+  size_t len;
+  size_t cap;
+  qoi_write_fn write;
+  void *ctx;
+  size_t total;  // bytes passed on to write
+} qoi_sink;
+
+/* Pass the buffered bytes on, returns 0 if that failed or there is no write
+ function to make room */
+static int qoi_sink_flush(qoi_sink *sink) {
+  if (!sink->write)
+    return 0;
+  if (sink->len > 0) {
+    if (!sink->write(sink->ctx, sink->bytes, sink->len))
+      return 0;
+    sink->total += sink->len;
+    sink->len = 0;
+  }
+  return 1;
+}
+
+static int qoi_sink_reserve(qoi_sink *sink, size_t n) {
+  return sink->cap - sink->len >= n || (qoi_sink_flush(sink) && sink->cap - sink->len >= n);
+}
+
+void qoi_interleave_rows(const void *data, int input, const qoi_desc *desc,
+                         unsigned char *dst, int y0, int rows, qoi_range *range) {
+  int width = desc->width, height = desc->height, channels = desc->channels;
+
+  switch (input) {
+  case QOI_INPUT_REAL:
+    qoi_interleaved_from_planar_real((const double *) data, dst, width, height, channels,
+                                     y0, rows, range);
+    break;
+  case QOI_INPUT_LOGICAL:
+    qoi_interleaved_from_planar_lgl((const int *) data, dst, width, height, channels, y0, rows);
+    break;
+  default:
+    qoi_interleaved_from_planar((const int *) data, dst, width, height, channels, y0, rows);
+  }
+}
+
+/* Encode the rows y0 .. y1 - 1 of an image held by R into sink. Planar
+ arrays are converted to an interleaved RGB(A) stream one band of rows at a
+ time, so only a small scratch buffer is needed on top of the output buffer;
+ raw arrays already are such a stream and are encoded as they are.
+ With restart set, the first pixel becomes a restart point (see
+ qoi_encode_restart()). The scratch buffer is taken from ctx if one is given.
+ Returns QOI_STREAM_OK, QOI_STREAM_EALLOC if the scratch buffer could not be
+ allocated or QOI_STREAM_EWRITE if the sink failed. */
+static int qoi_encode_rows(qoi_enc_state *state, const void *data, int input,
+                           const qoi_desc *desc, qoi_range *range, int y0, int y1,
+                           int restart, qoi_sink *sink, qoi_context *ctx) {
+  int width = desc->width, channels = desc->channels;
+  const unsigned char *rgb_values;
+  unsigned char *scratch = NULL;
+  int band_rows = y1 - y0, ret = QOI_STREAM_OK;
+
+  if (input != QOI_INPUT_RAW) {
+    band_rows = QOI_BAND_PIXELS / width;
+    if (band_rows < QOI_BAND_MIN_ROWS) band_rows = QOI_BAND_MIN_ROWS;
+    if (band_rows > y1 - y0) band_rows = y1 - y0;
+    scratch = qoi_buffer_take(ctx ? &ctx->scratch : NULL, (size_t) band_rows * width * channels);
+    if (!scratch)
+      return QOI_STREAM_EALLOC;
+  }
+
+  for (int y = y0; y < y1 && ret == QOI_STREAM_OK; y += band_rows) {
+    int rows = y1 - y < band_rows ? y1 - y : band_rows;
+    size_t n = (size_t) rows * width;
+
+    if (input != QOI_INPUT_RAW) {
+      qoi_interleave_rows(data, input, desc, scratch, y, rows, range);
+      rgb_values = scratch;
+    } else {
+      rgb_values = (const unsigned char *) data + (size_t) y * width * channels;
+    }
+
+    if (restart && y == y0) {
+      if (!qoi_sink_reserve(sink, channels + 2)) {
+        ret = QOI_STREAM_EWRITE;
+        break;
+      }
+      sink->len += qoi_encode_restart(state, rgb_values, channels, sink->bytes + sink->len);
+      rgb_values += channels;
+      n--;
+    }
+
+    // encode as many pixels as fit into the buffer in the worst case, which
+    // includes the byte of a run left pending by the previous piece
+    while (n > 0) {
+      size_t left = sink->cap - sink->len, pending = state->run > 0;
+      size_t room = left > pending ? (left - pending) / (channels + 1) : 0;
+      size_t piece = room < n ? room : n;
+
+      if (piece < n && piece < QOI_BLOCK_MIN_PIXELS) {
+        if (!qoi_sink_flush(sink)) {
+          ret = QOI_STREAM_EWRITE;
+          break;
+        }
+        continue;
+      }
+      sink->len += qoi_encode_pixels(state, rgb_values, piece, channels, sink->bytes + sink->len);
+      rgb_values += (size_t) piece * channels;
+      n -= piece;
+    }
+  }
+
+  qoi_buffer_release(ctx ? &ctx->scratch : NULL, scratch);
+  return ret;
+}
+
+/* Encode the whole image into sink, which has room for the worst case */
+static int qoi_encode_whole(const void *data, int input, const qoi_desc *desc,
+                            qoi_range *range, qoi_sink *sink, qoi_context *ctx) {
+  qoi_enc_state state;
+
+  qoi_encode_init(&state);
+  sink->len = qoi_encode_header(desc, sink->bytes);
+  if (qoi_encode_rows(&state, data, input, desc, range, 0, desc->height, 0, sink,
+                      ctx) != QOI_STREAM_OK)
+    return 0;
+  sink->len += qoi_encode_finish(&state, sink->bytes + sink->len);
+  return 1;
+}
+
+/* qoi_encode_image() with the values checked into range */
+static void *qoi_encode_alloc(const void *data, int input, const qoi_desc *desc,
+                              qoi_range *range, size_t *out_len) {
+  qoi_sink sink = {NULL, 0, 0, NULL, NULL, 0};
+
+  if (input == QOI_INPUT_RAW)
+    return qoi_encode(data, desc, out_len);
+
+  sink.cap = qoi_encode_max_size(desc);
+  sink.bytes = (unsigned char *) QOI_MALLOC(sink.cap);
+  if (!sink.bytes)
+    return NULL;
+
+  if (!qoi_encode_whole(data, input, desc, range, &sink, NULL)) {
+    QOI_FREE(sink.bytes);
+    return NULL;
+  }
+
+  *out_len = sink.len;
+  return sink.bytes;
+}
+
+void *qoi_encode_image(const void *data, int input, const qoi_desc *desc,
+                       size_t *out_len) {
+  return qoi_encode_alloc(data, input, desc, NULL, out_len);
+}
+
+size_t qoi_encode_image_ctx(const void *data, int input, const qoi_desc *desc,
+                            qoi_range *range, qoi_context *ctx) {
+  qoi_sink sink = {NULL, 0, 0, NULL, NULL, 0};
+
+  sink.cap = qoi_encode_max_size(desc);
+  sink.bytes = qoi_buffer_take(&ctx->output, sink.cap);
+  if (!sink.bytes || !qoi_encode_whole(data, input, desc, range, &sink, ctx))
+    return 0;
+  return sink.len;
+}
+
+int qoi_encode_image_stream(const void *data, int input, const qoi_desc *desc,
+                            qoi_range *range, qoi_write_fn write, void *ctx) {
+  qoi_enc_state state;
+  qoi_sink sink = {NULL, 0, QOI_BLOCK_SIZE, write, ctx, 0};
+  int ret;
+
+  sink.bytes = (unsigned char *) QOI_MALLOC(QOI_BLOCK_SIZE);
+  if (!sink.bytes)
+    return QOI_STREAM_EALLOC;
+
+  qoi_encode_init(&state);
+  sink.len = qoi_encode_header(desc, sink.bytes);
+  ret = qoi_encode_rows(&state, data, input, desc, range, 0, desc->height, 0, &sink, NULL);
+  if (ret == QOI_STREAM_OK) {
+    if (qoi_sink_reserve(&sink, 1 + sizeof(qoi_padding))) {
+      sink.len += qoi_encode_finish(&state, sink.bytes + sink.len);
+      ret = qoi_sink_flush(&sink) ? QOI_STREAM_OK : QOI_STREAM_EWRITE;
+    } else {
+      ret = QOI_STREAM_EWRITE;
+    }
+  }
+
+  QOI_FREE(sink.bytes);
+  return ret;
+}
+
+void *qoi_encode_image_striped(const void *data, int input, const qoi_desc *desc,
+                               qoi_range *range, int stripes, int threads,
+                               size_t *out_len) {
+  int width = desc->width, height = desc->height, channels = desc->channels;
+  unsigned char *encoded;
+  size_t *start, *length, total;
+  uint64_t *offsets;
+  qoi_range *ranges;
+  int stripe_rows, failed = 0;
+
+#ifndef _OPENMP
+  (void) threads;
+#endif
+
+  if (stripes < 2)
+    return qoi_encode_alloc(data, input, desc, range, out_len);
+
+  stripe_rows = (height + stripes - 1) / stripes;
+  stripes = (height + stripe_rows - 1) / stripe_rows;
+
+  // every stripe counts the values out of range in its own rows
+  start = (size_t *) malloc(stripes * sizeof(size_t));
+  length = (size_t *) malloc(stripes * sizeof(size_t));
+  offsets = (uint64_t *) malloc(stripes * sizeof(uint64_t));
+  ranges = (qoi_range *) calloc(stripes, sizeof(qoi_range));
+  if (!start || !length || !offsets || !ranges) {
+    free(start); free(length); free(offsets); free(ranges);
+    return NULL;
+  }
+
+  // every stripe gets its worst case region of the output buffer, which is
+  // compacted once all of them are encoded
+  total = QOI_HEADER_SIZE;
+  for (int k = 0; k < stripes; k++) {
+    int rows = height - k * stripe_rows < stripe_rows ? height - k * stripe_rows : stripe_rows;
+    start[k] = total;
+    total += (size_t) rows * width * (channels + 1) + 1;
+  }
+  total += sizeof(qoi_padding) + qoi_trailer_size(stripes);
+
+  encoded = (unsigned char *) QOI_MALLOC(total);
+  if (!encoded) {
+    free(start); free(length); free(offsets); free(ranges);
+    return NULL;
+  }
+  qoi_encode_header(desc, encoded);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic) reduction(|:failed)
+#endif
+  for (int k = 0; k < stripes; k++) {
+    int y0 = k * stripe_rows;
+    int y1 = y0 + stripe_rows < height ? y0 + stripe_rows : height;
+    qoi_enc_state state;
+    qoi_sink sink = {encoded + start[k], 0, (size_t) (y1 - y0) * width * (channels + 1) + 1,
+                     NULL, NULL, 0};
+
+    // the first stripe starts like any QOI stream, all others at a restart point
+    qoi_encode_init(&state);
+    if (qoi_encode_rows(&state, data, input, desc, range ? &ranges[k] : NULL, y0, y1, k > 0,
+                        &sink, NULL) != QOI_STREAM_OK) {
+      failed = 1;
+      continue;
+    }
+    sink.len += qoi_encode_flush(&state, sink.bytes + sink.len);
+    length[k] = sink.len;
+  }
+
+  if (failed) {
+    QOI_FREE(encoded);
+    free(start); free(length); free(offsets); free(ranges);
+    return NULL;
+  }
+
+  total = QOI_HEADER_SIZE;
+  for (int k = 0; k < stripes; k++) {
+    if (range)
+      qoi_range_merge(range, &ranges[k]);
+    memmove(encoded + total, encoded + start[k], length[k]);
+    offsets[k] = total;
+    total += length[k];
+  }
+  memcpy(encoded + total, qoi_padding, sizeof(qoi_padding));
+  total += sizeof(qoi_padding);
+  total += qoi_trailer_write(encoded + total, QOI_STRIPE_MAGIC, stripe_rows, offsets, stripes);
+
+  free(start); free(length); free(offsets); free(ranges);
+  *out_len = total;
+  return encoded;
+}
@@ -0,0 +1,126 @@
+#ifndef QOI_IMAGE_H
+#define QOI_IMAGE_H
+
+#include <stddef.h>
+#include "qoi.h"
+#include "buffer.h"
+#include "transpose.h"
+
+/* Layouts of decoded images as they are handed to R, see readQOI(format = ) */
+#define QOI_FORMAT_ARRAY         0 /* integer, height x width x channels, planar */
+#define QOI_FORMAT_RAW           1 /* raw, channels x width x height, interleaved */
+#define QOI_FORMAT_NATIVE_RASTER 2 /* integer, height x width, packed RGBA */
+
+/* Layouts of images given to the encoder, see writeQOI(image = ). All but
+ QOI_INPUT_RAW are planar, height x width x channels, and converted to
+ interleaved pixels one band of rows at a time. */
+#define QOI_INPUT_RAW     0 /* raw, channels x width x height, interleaved */
+#define QOI_INPUT_INTEGER 1 /* integer, 0..255 (clamped) */
+#define QOI_INPUT_REAL    2 /* double, 0..1 (scaled, rounded and clamped) */
+#define QOI_INPUT_LOGICAL 3 /* logical, TRUE as 255 */
+
+/* The functions below do not touch the R API, so they can be used on worker
+ threads as long as the memory of the R vectors was obtained beforehand. */
+
+/* Buffers of a codec context (see qoiContext()), reused by every call that is
+ given the context instead of being allocated and freed each time. A context
+ must not be used by two calls at once. */
+typedef struct {
+  qoi_buffer input;   // content of a file being decoded
+  qoi_buffer scratch; // interleaved band of rows of a planar image
+  qoi_buffer row;     // one row of 4 bytes per pixel for region reads
+  qoi_buffer output;  // encoded image, see qoi_encode_image_ctx()
+} qoi_context;
+
+void qoi_context_free(qoi_context *ctx);
+
+/* Decode the chunks of a QOI image whose header was read into desc straight
+ into `out`, the data of a result vector of the given format. The planar
+ layout is filled one band of rows at a time through a small scratch buffer.
+ Returns 0 on corrupt data or if the scratch buffer could not be allocated. */
+int qoi_decode_image(const void *data, size_t size, const qoi_desc *desc,
+                     int format, void *out);
+
+/* Decode a QOI image scaled down by the integer factor `scale` into `out`,
+ which has the given format for an image of (width + scale - 1) / scale x
+ (height + scale - 1) / scale pixels. Every output pixel is the rounded mean
+ of a scale x scale box of the image (smaller at the right and bottom edges).
+ The rows are summed up column by column as they are decoded, so besides
+ the output only one row of the image and one row of sums are held. Returns 0 on corrupt data or
+ if the buffers could not be allocated. scale is at most QOI_SCALE_MAX, so
+ that the sums of a column over scale rows fit 16 bits. */
+#define QOI_SCALE_MAX 256
+
+int qoi_decode_image_scaled(const void *data, size_t size, const qoi_desc *desc,
+                            int scale, int format, void *out);
+
+/* Decode a QOI image into slice n of a stack of `count` images of the same
+ size in the layout count x channels x height x width (R's dimensions, so
+ the image index varies fastest). The image is decoded one band of rows at a
+ time into a small scratch buffer and scattered from there. Returns 0 on
+ corrupt data or if the scratch buffer could not be allocated. */
+int qoi_decode_image_nchw(const void *data, size_t size, const qoi_desc *desc,
+                          int *out, size_t n, size_t count);
+
+/* Turn RGBA pixels decoded into a native raster into R's packed colours */
+void qoi_native_raster_order(unsigned int *packed, size_t n);
+
+/* Like qoi_decode_image(), but only the w x h pixels starting at column x0 and
+ row y0 are decoded into `out`, which has the layout of a w x h image. An
+ optional row index (see seek.h) lets decoding start close to y0. The buffers
+ are taken from ctx unless it is NULL. */
+int qoi_decode_image_region(const void *data, size_t size, const qoi_desc *desc,
+                            const unsigned char *index, int x0, int y0,
+                            int w, int h, int format, void *out,
+                            qoi_context *ctx);
+
+/* Convert `rows` rows from row y0 on of a planar image with the given input
+ layout into interleaved pixels in dst. Values of a double image outside of
+ 0..1 are counted into range unless it is NULL. */
+void qoi_interleave_rows(const void *data, int input, const qoi_desc *desc,
+                         unsigned char *dst, int y0, int rows, qoi_range *range);
+
+/* Encode an image as it is stored by R, in one of the input layouts above.
+ Returns the QOI_MALLOC()ed encoded data or NULL. */
+void *qoi_encode_image(const void *data, int input, const qoi_desc *desc,
+                       size_t *out_len);
+
+/* The encoders below take a range as qoi_interleave_rows() does (NULL if
+ the values are not checked). */
+
+/* Like qoi_encode_image(), but the encoded image is left in ctx->output, which
+ grows to the worst case size of the largest image encoded with the context
+ so far. Returns the size of the encoded image or 0 if a buffer could not be
+ allocated. */
+size_t qoi_encode_image_ctx(const void *data, int input, const qoi_desc *desc,
+                            qoi_range *range, qoi_context *ctx);
+
+/* Streaming variant of qoi_encode_image(): instead of a worst case buffer for
+ the whole image only one block of QOI_BLOCK_SIZE bytes is allocated, which is
+ passed to write(ctx, bytes, len) whenever it is full and at the end. write
+ returns 0 to abort encoding. Returns QOI_STREAM_OK, QOI_STREAM_EALLOC if a
+ buffer could not be allocated or QOI_STREAM_EWRITE if write failed. */
+#define QOI_BLOCK_SIZE 65536
+
+#define QOI_STREAM_OK      0
+#define QOI_STREAM_EALLOC -1
+#define QOI_STREAM_EWRITE -2
+
+typedef int (*qoi_write_fn)(void *ctx, const unsigned char *bytes, size_t len);
+
+int qoi_encode_image_stream(const void *data, int input, const qoi_desc *desc,
+                            qoi_range *range, qoi_write_fn write, void *ctx);
+
+/* Like qoi_encode_image(), but the image is cut into `stripes` horizontal
+ bands which are encoded on up to `threads` threads. Every band but the first
+ begins at a restart point (see qoi_encode_restart()), so the bands simply
+ follow each other in one valid QOI stream. Behind the end marker a trailer
+ (see trailer.h) with the magic QOI_STRIPE_MAGIC records the byte offset of
+ each band; its parameter is the number of rows per band. */
+#define QOI_STRIPE_MAGIC "qoiS"
+
+void *qoi_encode_image_striped(const void *data, int input, const qoi_desc *desc,
+                               qoi_range *range, int stripes, int threads,
+                               size_t *out_len);
+
+#endif // QOI_IMAGE_H
@@ -2,12 +2,33 @@
 #include <R.h>
 #include <Rinternals.h>
 
+#include "transpose.h"
+#include "scan.h"
+#include "rqoi.h"
+
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // Many thanks to coolbutuseless for the great tutorials!
 // https://github.com/coolbutuseless/simplecall
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-extern SEXP qoiRead_(SEXP);
-extern SEXP qoiWrite_(SEXP, SEXP);
+extern SEXP qoiRead_(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP qoiIndex_(SEXP, SEXP);
+extern SEXP qoiReadRegion_(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP qoiReadScaled_(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP qoiStats_(SEXP, SEXP, SEXP);
+extern SEXP qoiDecoder_(SEXP);
+extern SEXP qoiDecoderPush_(SEXP, SEXP, SEXP);
+extern SEXP qoiDecoderImage_(SEXP);
+extern SEXP qoiWrite_(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP qoiReadBatch_(SEXP, SEXP, SEXP);
+extern SEXP qoiReadStack_(SEXP, SEXP, SEXP);
+extern SEXP qoiInfo_(SEXP, SEXP);
+extern SEXP qoiWriteBatch_(SEXP, SEXP, SEXP);
+extern SEXP qoiContext_(void);
+extern SEXP qoiContextSize_(SEXP);
+extern SEXP qoiFrameCount_(SEXP);
+extern SEXP qoiReadFrame_(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP qoiWriteFrames_(SEXP, SEXP, SEXP, SEXP);
+extern SEXP qoiDevice_(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // .C      R_CMethodDef
@@ -15,8 +36,25 @@ extern SEXP qoiWrite_(SEXP, SEXP);
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 static const R_CallMethodDef CEntries[] = {
   // name       pointer               Num args
-  {"qoiRead_", (DL_FUNC) &qoiRead_, 1},
-  {"qoiWrite_", (DL_FUNC) &qoiWrite_, 2},
+  {"qoiRead_", (DL_FUNC) &qoiRead_, 5},
+  {"qoiIndex_", (DL_FUNC) &qoiIndex_, 2},
+  {"qoiReadRegion_", (DL_FUNC) &qoiReadRegion_, 6},
+  {"qoiReadScaled_", (DL_FUNC) &qoiReadScaled_, 5},
+  {"qoiStats_", (DL_FUNC) &qoiStats_, 3},
+  {"qoiDecoder_", (DL_FUNC) &qoiDecoder_, 1},
+  {"qoiDecoderPush_", (DL_FUNC) &qoiDecoderPush_, 3},
+  {"qoiDecoderImage_", (DL_FUNC) &qoiDecoderImage_, 1},
+  {"qoiWrite_", (DL_FUNC) &qoiWrite_, 6},
+  {"qoiReadBatch_", (DL_FUNC) &qoiReadBatch_, 3},
+  {"qoiReadStack_", (DL_FUNC) &qoiReadStack_, 3},
+  {"qoiInfo_", (DL_FUNC) &qoiInfo_, 2},
+  {"qoiWriteBatch_", (DL_FUNC) &qoiWriteBatch_, 3},
+  {"qoiContext_", (DL_FUNC) &qoiContext_, 0},
+  {"qoiContextSize_", (DL_FUNC) &qoiContextSize_, 1},
+  {"qoiFrameCount_", (DL_FUNC) &qoiFrameCount_, 1},
+  {"qoiReadFrame_", (DL_FUNC) &qoiReadFrame_, 5},
+  {"qoiWriteFrames_", (DL_FUNC) &qoiWriteFrames_, 4},
+  {"qoiDevice_", (DL_FUNC) &qoiDevice_, 6},
   {NULL       , NULL                , 0}   // Placeholder to indicate last one.
 };
 
@@ -33,4 +71,11 @@ void R_init_qoi(DllInfo *info) {
     NULL       // External
   );
   R_useDynamicSymbols(info, FALSE);
+
+  // pick the planar <-> interleaved and encoder scan kernels for this CPU
+  qoi_transpose_init();
+  qoi_scan_init();
+
+  // ALTREP classes of readQOI(lazy = TRUE)
+  qoi_lazy_init(info);
 }
@@ -0,0 +1,277 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <Rversion.h>
+
+#include <string.h>
+#include "qoi.h"
+#include "image.h"
+#include "rqoi.h"
+
+/* Lazily decoded images returned by readQOI(lazy = TRUE).
+
+ The vector is an ALTREP integer (array, nativeRaster) or raw vector whose
+ data1 is a list of the encoded bytes and an integer state (format, number of
+ partial decodes) and whose data2 is the decoded vector once it exists. Its
+ length and attributes come from the header alone. Asking for the data
+ pointer decodes the whole image into data2, after which the encoded bytes are
+ dropped; reading single elements or regions before that decodes only the
+ rows they lie in. */
+
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 5, 0)
+#define QOI_HAVE_ALTREP
+#include <R_ext/Altrep.h>
+#endif
+
+#ifdef QOI_HAVE_ALTREP
+
+/* Without a row index every partial decode starts at the first row, so after
+ this many of them the next access decodes the whole image instead: a loop
+ over the elements then costs one decode rather than one per element. */
+#define QOI_LAZY_PARTIAL_MAX 8
+
+#define QOI_LAZY_BYTES 0
+#define QOI_LAZY_STATE 1
+
+static R_altrep_class_t qoi_lazy_int_class, qoi_lazy_raw_class;
+
+static SEXP qoi_lazy_new(SEXP bytes, int format) {
+  SEXP data1 = PROTECT(allocVector(VECSXP, 2));
+  SEXP state = allocVector(INTSXP, 2);
+
+  SET_VECTOR_ELT(data1, QOI_LAZY_BYTES, bytes);
+  SET_VECTOR_ELT(data1, QOI_LAZY_STATE, state);
+  INTEGER(state)[0] = format;
+  INTEGER(state)[1] = 0;
+
+  // the bytes may be the raw vector readQOI() was given
+  MARK_NOT_MUTABLE(bytes);
+  SEXP res = R_new_altrep(format == QOI_FORMAT_RAW ? qoi_lazy_raw_class : qoi_lazy_int_class,
+                          data1, R_NilValue);
+  UNPROTECT(1);
+  return res;
+}
+
+static SEXP qoi_lazy_bytes(SEXP x) {
+  return VECTOR_ELT(R_altrep_data1(x), QOI_LAZY_BYTES);
+}
+
+static int *qoi_lazy_state(SEXP x) {
+  return INTEGER(VECTOR_ELT(R_altrep_data1(x), QOI_LAZY_STATE));
+}
+
+/* The header was validated when the vector was created */
+static void qoi_lazy_desc(SEXP x, qoi_desc *desc) {
+  SEXP bytes = qoi_lazy_bytes(x);
+  qoi_decode_header(RAW(bytes), XLENGTH(bytes), desc);
+}
+
+static SEXP qoi_lazy_expand(SEXP x) {
+  SEXP full = R_altrep_data2(x), bytes;
+  int format = qoi_lazy_state(x)[0];
+  qoi_desc desc;
+
+  if (full != R_NilValue)
+    return full;
+
+  bytes = qoi_lazy_bytes(x);
+  qoi_lazy_desc(x, &desc);
+  full = PROTECT(allocVector(format == QOI_FORMAT_RAW ? RAWSXP : INTSXP,
+                             qoi_image_length(&desc, format)));
+  if (!qoi_decode_image(RAW(bytes), XLENGTH(bytes), &desc, format, qoi_image_data(full)))
+    Rf_error("Decoding went wrong!");
+
+  // the pixels may be changed from now on, so the encoded image is outdated
+  R_set_altrep_data2(x, full);
+  SET_VECTOR_ELT(R_altrep_data1(x), QOI_LAZY_BYTES, R_NilValue);
+  UNPROTECT(1);
+  return full;
+}
+
+/* Decode only the rows holding the n elements from i on into buf. Returns 0
+ if the region is too large for that or the partial decodes are used up. */
+static int qoi_lazy_partial(SEXP x, R_xlen_t i, R_xlen_t n, void *buf) {
+  SEXP bytes = qoi_lazy_bytes(x);
+  int *state = qoi_lazy_state(x), format = state[0], ok;
+  size_t elt = format == QOI_FORMAT_RAW ? 1 : sizeof(int);
+  const void *vmax = vmaxget();
+  char *tmp;
+  qoi_desc desc;
+
+  if (state[1] >= QOI_LAZY_PARTIAL_MAX)
+    return 0;
+  qoi_lazy_desc(x, &desc);
+
+  if (format == QOI_FORMAT_ARRAY) {
+    // planar: a region within one column of one channel
+    R_xlen_t h = desc.height, y = i % h, col = i / h;
+    int x0 = (int) (col % desc.width), plane = (int) (col / desc.width);
+
+    if (y + n > h)
+      return 0;
+    tmp = R_alloc((size_t) n * desc.channels, sizeof(int));
+    ok = qoi_decode_image_region(RAW(bytes), XLENGTH(bytes), &desc, NULL, x0, (int) y,
+                                 1, (int) n, format, tmp, NULL);
+    if (ok)
+      memcpy(buf, tmp + (size_t) plane * n * elt, n * elt);
+  } else {
+    // row by row: the complete rows the region touches
+    R_xlen_t per_row = (R_xlen_t) desc.width * (format == QOI_FORMAT_RAW ? desc.channels : 1);
+    R_xlen_t y0 = i / per_row, rows = (i + n - 1) / per_row - y0 + 1;
+
+    if (rows > (R_xlen_t) desc.height / 4 + 1)
+      return 0;
+    tmp = R_alloc((size_t) rows * per_row, elt);
+    ok = qoi_decode_image_region(RAW(bytes), XLENGTH(bytes), &desc, NULL, 0, (int) y0,
+                                 desc.width, (int) rows, format, tmp, NULL);
+    if (ok)
+      memcpy(buf, tmp + (size_t) (i - y0 * per_row) * elt, n * elt);
+  }
+  vmaxset(vmax);
+
+  if (!ok)
+    Rf_error("Decoding went wrong!");
+  state[1]++;
+  return 1;
+}
+
+static R_xlen_t qoi_lazy_length(SEXP x) {
+  SEXP full = R_altrep_data2(x);
+  qoi_desc desc;
+
+  if (full != R_NilValue)
+    return XLENGTH(full);
+  qoi_lazy_desc(x, &desc);
+  return qoi_image_length(&desc, qoi_lazy_state(x)[0]);
+}
+
+static R_xlen_t qoi_lazy_region(SEXP x, R_xlen_t i, R_xlen_t n, void *buf) {
+  R_xlen_t len = qoi_lazy_length(x);
+  SEXP full = R_altrep_data2(x);
+  size_t elt;
+
+  if (n > len - i)
+    n = len - i;
+  if (n <= 0)
+    return 0;
+
+  if (full == R_NilValue && qoi_lazy_partial(x, i, n, buf))
+    return n;
+
+  full = qoi_lazy_expand(x);
+  elt = TYPEOF(full) == RAWSXP ? 1 : sizeof(int);
+  memcpy(buf, (const char *) qoi_image_data(full) + (size_t) i * elt, (size_t) n * elt);
+  return n;
+}
+
+static void *qoi_lazy_dataptr(SEXP x, Rboolean writeable) {
+  (void) writeable;
+  return qoi_image_data(qoi_lazy_expand(x));
+}
+
+static const void *qoi_lazy_dataptr_or_null(SEXP x) {
+  SEXP full = R_altrep_data2(x);
+  return full == R_NilValue ? NULL : qoi_image_data(full);
+}
+
+static int qoi_lazy_int_elt(SEXP x, R_xlen_t i) {
+  int v;
+  qoi_lazy_region(x, i, 1, &v);
+  return v;
+}
+
+static R_xlen_t qoi_lazy_int_get_region(SEXP x, R_xlen_t i, R_xlen_t n, int *buf) {
+  return qoi_lazy_region(x, i, n, buf);
+}
+
+static Rbyte qoi_lazy_raw_elt(SEXP x, R_xlen_t i) {
+  Rbyte v;
+  qoi_lazy_region(x, i, 1, &v);
+  return v;
+}
+
+static R_xlen_t qoi_lazy_raw_get_region(SEXP x, R_xlen_t i, R_xlen_t n, Rbyte *buf) {
+  return qoi_lazy_region(x, i, n, buf);
+}
+
+/* Copies of an image which was not decoded yet share its encoded bytes;
+ decoded ones are copied as ordinary vectors (NULL) */
+static SEXP qoi_lazy_duplicate(SEXP x, Rboolean deep) {
+  (void) deep;
+  if (R_altrep_data2(x) != R_NilValue)
+    return NULL;
+  return qoi_lazy_new(qoi_lazy_bytes(x), qoi_lazy_state(x)[0]);
+}
+
+/* Not decoded yet, an image is serialized as its encoded bytes */
+static SEXP qoi_lazy_serialized_state(SEXP x) {
+  if (R_altrep_data2(x) != R_NilValue)
+    return NULL;
+  return R_altrep_data1(x);
+}
+
+static SEXP qoi_lazy_unserialize(SEXP class, SEXP state) {
+  (void) class;
+  return qoi_lazy_new(VECTOR_ELT(state, QOI_LAZY_BYTES),
+                      INTEGER(VECTOR_ELT(state, QOI_LAZY_STATE))[0]);
+}
+
+static Rboolean qoi_lazy_inspect(SEXP x, int pre, int deep, int pvec,
+                                 void (*inspect_subtree)(SEXP, int, int, int)) {
+  SEXP full = R_altrep_data2(x);
+
+  if (full != R_NilValue) {
+    Rprintf(" qoi lazy image (decoded)\n");
+    inspect_subtree(full, pre, deep, pvec);
+  } else {
+    Rprintf(" qoi lazy image (%.0f encoded bytes)\n", (double) XLENGTH(qoi_lazy_bytes(x)));
+  }
+  return TRUE;
+}
+
+static void qoi_lazy_methods(R_altrep_class_t cls) {
+  R_set_altrep_Length_method(cls, qoi_lazy_length);
+  R_set_altrep_Inspect_method(cls, qoi_lazy_inspect);
+  R_set_altrep_Duplicate_method(cls, qoi_lazy_duplicate);
+  R_set_altrep_Serialized_state_method(cls, qoi_lazy_serialized_state);
+  R_set_altrep_Unserialize_method(cls, qoi_lazy_unserialize);
+  R_set_altvec_Dataptr_method(cls, qoi_lazy_dataptr);
+  R_set_altvec_Dataptr_or_null_method(cls, qoi_lazy_dataptr_or_null);
+}
+
+void qoi_lazy_init(DllInfo *dll) {
+  qoi_lazy_int_class = R_make_altinteger_class("qoi_lazy_int", "qoi", dll);
+  qoi_lazy_methods(qoi_lazy_int_class);
+  R_set_altinteger_Elt_method(qoi_lazy_int_class, qoi_lazy_int_elt);
+  R_set_altinteger_Get_region_method(qoi_lazy_int_class, qoi_lazy_int_get_region);
+
+  qoi_lazy_raw_class = R_make_altraw_class("qoi_lazy_raw", "qoi", dll);
+  qoi_lazy_methods(qoi_lazy_raw_class);
+  R_set_altraw_Elt_method(qoi_lazy_raw_class, qoi_lazy_raw_elt);
+  R_set_altraw_Get_region_method(qoi_lazy_raw_class, qoi_lazy_raw_get_region);
+}
+
+int qoi_lazy_available(void) {
+  return 1;
+}
+
+SEXP qoi_lazy_image(SEXP bytes, const qoi_desc *desc, int format) {
+  SEXP res = PROTECT(qoi_lazy_new(bytes, format));
+  qoi_image_attributes(res, desc, format);
+  UNPROTECT(1);
+  return res;
+}
+
+#else
+
+void qoi_lazy_init(DllInfo *dll) {
+}
+
+int qoi_lazy_available(void) {
+  return 0;
+}
+
+SEXP qoi_lazy_image(SEXP bytes, const qoi_desc *desc, int format) {
+  return R_NilValue;
+}
+
+#endif
@@ -0,0 +1,229 @@
+/* 64-bit file offsets for stat() and ftello() on 32-bit POSIX systems */
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "mapfile.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* largest piece handed to a single fread(), some C libraries fail on
+ requests of 2 GiB and more */
+#define QOI_READ_PIECE ((size_t) 1 << 30)
+
+int qoi_fseek(FILE *f, int64_t offset, int whence) {
+#ifdef _WIN32
+  return _fseeki64(f, offset, whence);
+#else
+  return fseeko(f, (off_t) offset, whence);
+#endif
+}
+
+int64_t qoi_ftell(FILE *f) {
+#ifdef _WIN32
+  return _ftelli64(f);
+#else
+  return (int64_t) ftello(f);
+#endif
+}
+
+int qoi_ftruncate(FILE *f, int64_t size) {
+  if (fflush(f) != 0)
+    return -1;
+#ifdef _WIN32
+  return _chsize_s(_fileno(f), size) == 0 ? 0 : -1;
+#else
+  return ftruncate(fileno(f), (off_t) size);
+#endif
+}
+
+/* Size of the file behind f, which is left at its start */
+static int64_t qoi_file_size(FILE *f) {
+  int64_t size;
+
+  qoi_fseek(f, 0, SEEK_END);
+  size = qoi_ftell(f);
+  qoi_fseek(f, 0, SEEK_SET);
+  return size;
+}
+
+/* Read size bytes from f into buf, in pieces of at most QOI_READ_PIECE */
+static int qoi_read_all(FILE *f, unsigned char *buf, size_t size) {
+  for (size_t p = 0; p < size; ) {
+    size_t n = size - p < QOI_READ_PIECE ? size - p : QOI_READ_PIECE;
+    if (fread(buf + p, 1, n, f) != n)
+      return 0;
+    p += n;
+  }
+  return 1;
+}
+
+/* Read the whole file into buf if one is given or into a heap buffer of its
+ own otherwise */
+static int qoi_read_file(const char *filename, qoi_buffer *into, qoi_file_map *map) {
+  FILE *f = fopen(filename, "rb");
+  unsigned char *buf;
+  int64_t size;
+
+  if (!f) return QOI_MAP_EOPEN;
+
+  size = qoi_file_size(f);
+  if (size <= 0) {
+    fclose(f);
+    return QOI_MAP_EEMPTY;
+  }
+
+  buf = (uint64_t) size > SIZE_MAX ? NULL : qoi_buffer_take(into, (size_t) size);
+  if (!buf) {
+    fclose(f);
+    return QOI_MAP_EREAD;
+  }
+
+  if (!qoi_read_all(f, buf, (size_t) size)) {
+    qoi_buffer_release(into, buf);
+    fclose(f);
+    return QOI_MAP_EREAD;
+  }
+  fclose(f);
+
+  map->data = buf;
+  map->size = (size_t) size;
+  map->mapped = into ? QOI_MAP_BORROWED : 0;
+  return QOI_MAP_OK;
+}
+
+int qoi_map_file(const char *filename, qoi_file_map *map) {
+  map->data = NULL;
+  map->size = 0;
+  map->mapped = 0;
+
+#ifndef _WIN32
+  struct stat st;
+  void *addr;
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0) return QOI_MAP_EOPEN;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    /* pipes, devices and friends cannot be mapped */
+    close(fd);
+    return qoi_read_file(filename, NULL, map);
+  }
+  if (st.st_size <= 0) {
+    close(fd);
+    return QOI_MAP_EEMPTY;
+  }
+  if ((uint64_t) st.st_size > SIZE_MAX) {
+    /* larger than the address space of a 32-bit process */
+    close(fd);
+    return QOI_MAP_EREAD;
+  }
+
+  addr = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return qoi_read_file(filename, NULL, map);
+  }
+#ifdef MADV_SEQUENTIAL
+  madvise(addr, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif
+
+  map->data = (const unsigned char *) addr;
+  map->size = (size_t) st.st_size;
+  map->mapped = 1;
+  return QOI_MAP_OK;
+#else
+  return qoi_read_file(filename, NULL, map);
+#endif
+}
+
+int qoi_read_file_into(const char *filename, qoi_buffer *buf, qoi_file_map *map) {
+  map->data = NULL;
+  map->size = 0;
+  map->mapped = 0;
+  return qoi_read_file(filename, buf, map);
+}
+
+void qoi_unmap_file(qoi_file_map *map) {
+  if (map->data == NULL) return;
+
+#ifndef _WIN32
+  if (map->mapped == 1)
+    munmap((void *) map->data, map->size);
+  else if (map->mapped == 0)
+    free((void *) map->data);
+#else
+  if (map->mapped == 0)
+    free((void *) map->data);
+#endif
+
+  map->data = NULL;
+  map->size = 0;
+  map->mapped = 0;
+}
+
+static int qoi_read_stream_head(const char *filename, unsigned char *head,
+                                size_t n, size_t *file_size) {
+  FILE *f = fopen(filename, "rb");
+  int64_t size;
+
+  if (!f) return QOI_MAP_EOPEN;
+
+  size = qoi_file_size(f);
+  if (size <= 0) {
+    fclose(f);
+    return QOI_MAP_EEMPTY;
+  }
+  if ((uint64_t) size < n || fread(head, 1, n, f) != n) {
+    fclose(f);
+    return QOI_MAP_EREAD;
+  }
+  fclose(f);
+
+  *file_size = (size_t) size;
+  return QOI_MAP_OK;
+}
+
+int qoi_read_file_head(const char *filename, unsigned char *head, size_t n,
+                       size_t *file_size) {
+#ifndef _WIN32
+  /* one fstat() and one pread(), no stdio buffer filled with bytes that are
+   never looked at */
+  struct stat st;
+  ssize_t got;
+  int fd = open(filename, O_RDONLY);
+
+  if (fd < 0) return QOI_MAP_EOPEN;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return qoi_read_stream_head(filename, head, n, file_size);
+  }
+  if (st.st_size <= 0) {
+    close(fd);
+    return QOI_MAP_EEMPTY;
+  }
+  if ((size_t) st.st_size < n) {
+    close(fd);
+    return QOI_MAP_EREAD;
+  }
+
+  got = pread(fd, head, n, 0);
+  close(fd);
+  if (got < 0 || (size_t) got != n)
+    return QOI_MAP_EREAD;
+
+  *file_size = (size_t) st.st_size;
+  return QOI_MAP_OK;
+#else
+  return qoi_read_stream_head(filename, head, n, file_size);
+#endif
+}
@@ -0,0 +1,50 @@
+#ifndef QOI_MAPFILE_H
+#define QOI_MAPFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "buffer.h"
+
+/* A read-only view of a whole file. On POSIX systems the file is memory-mapped
+ so the decoder reads straight from the page cache; elsewhere (or if mmap()
+ fails) the content is read into a single heap buffer. mapped is 1 for a
+ mapping, 0 for a heap buffer of its own and QOI_MAP_BORROWED for a buffer
+ owned by the caller, see qoi_read_file_into(). */
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  int mapped;
+} qoi_file_map;
+
+#define QOI_MAP_BORROWED 2
+
+#define QOI_MAP_OK      0
+#define QOI_MAP_EOPEN  -1
+#define QOI_MAP_EEMPTY -2
+#define QOI_MAP_EREAD  -3
+
+int qoi_map_file(const char *filename, qoi_file_map *map);
+void qoi_unmap_file(qoi_file_map *map);
+
+/* Read the whole file into buf, which is grown as needed and stays owned by
+ the caller. Repeated reads of similar files then reuse memory whose pages
+ are already resident instead of mapping every file anew. The map still has
+ to be passed to qoi_unmap_file(), which leaves buf alone. */
+int qoi_read_file_into(const char *filename, qoi_buffer *buf, qoi_file_map *map);
+
+/* Read only the first n bytes of a file (e.g. a QOI header) and its total
+ size, without mapping or buffering the rest. */
+int qoi_read_file_head(const char *filename, unsigned char *head, size_t n,
+                       size_t *file_size);
+
+/* fseek() and ftell() with 64-bit offsets, also where long has 32 bits (as
+ on Windows) */
+int qoi_fseek(FILE *f, int64_t offset, int whence);
+int64_t qoi_ftell(FILE *f);
+
+/* Cut the file behind f (opened for writing) to size bytes. Returns 0 on
+ success like fseek(). */
+int qoi_ftruncate(FILE *f, int64_t size);
+
+#endif // QOI_MAPFILE_H
@@ -214,6 +214,10 @@
 #ifndef QOI_H
 #define QOI_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
 #define QOI_SRGB   0
 #define QOI_LINEAR 1
 
@@ -232,6 +236,14 @@ typedef struct {
 #define QOI_ZEROARR(a) memset((a),0,sizeof(a))
 #endif
 
+/* Small kernels which loops instantiate for 3 and 4 channels are always
+ inlined, so that `channels` is a constant inside them */
+#ifdef __GNUC__
+#define QOI_INLINE static inline __attribute__((always_inline))
+#else
+#define QOI_INLINE static inline
+#endif
+
 #define QOI_OP_INDEX  0x00 /* 00xxxxxx */
 #define QOI_OP_DIFF   0x40 /* 01xxxxxx */
 #define QOI_OP_LUMA   0x80 /* 10xxxxxx */
@@ -242,16 +254,38 @@ typedef struct {
 #define QOI_MASK_2    0xc0 /* 11000000 */
 //
 #define QOI_COLOR_HASH(C) (C.rgba.r*3 + C.rgba.g*5 + C.rgba.b*7 + C.rgba.a*11)
+
+/* QOI_COLOR_HASH(px) % 64 on the packed pixel: the even and the odd bytes are
+ multiplied separately so the weighted sums land in bits 16 and up without
+ carries between them. Needs red in the lowest byte. */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define QOI_PX_HASH(px) \
+  (((((px).v & 0xff00ffu) * 0x30007u + (((px).v >> 8) & 0xff00ffu) * 0x5000bu)) >> 16 & 63)
+#else
+#define QOI_PX_HASH(px) (QOI_COLOR_HASH(px) % 64)
+#endif
 #define QOI_MAGIC                                        \
 (((unsigned int)'q') << 24 | ((unsigned int)'o') << 16 | \
 ((unsigned int)'i') <<  8 | ((unsigned int)'f'))
 #define QOI_HEADER_SIZE 14
 
-/* 2GB is the max file size that this implementation can safely handle. We guard
- against anything larger than that, assuming the worst case with 5 bytes per
- pixel, rounded down to a nice clean value. 400 million pixels ought to be
- enough for anybody. */
-#define QOI_PIXELS_MAX ((unsigned int)400000000)
+/* Sizes and pixel counts are size_t throughout, so with 64-bit sizes the only
+ limit is that the worst case of 5 bytes per pixel still fits: images of up
+ to 2^40 pixels are accepted. Where size_t has 32 bits the 2GB limit of the
+ original implementation stays, rounded down to 400 million pixels. Width
+ and height are limited to INT_MAX each, the largest dimension of an R
+ array. */
+#if SIZE_MAX > 0xffffffffu
+#define QOI_PIXELS_MAX ((uint64_t)1 << 40)
+#else
+#define QOI_PIXELS_MAX ((uint64_t)400000000)
+#endif
+#define QOI_DIM_MAX ((unsigned int)INT_MAX)
+
+#define qoi_desc_valid(desc) \
+((desc)->width > 0 && (desc)->height > 0 && \
+(desc)->width <= QOI_DIM_MAX && (desc)->height <= QOI_DIM_MAX && \
+(desc)->height < QOI_PIXELS_MAX / (desc)->width)
 
 typedef union {
   struct { unsigned char r, g, b, a; } rgba;
@@ -275,4 +309,98 @@ static unsigned int qoi_read_32(const unsigned char *bytes, int *p) {
   return a << 24 | b << 16 | c << 8 | d;
 }
 
+/* Decode a QOI image from memory.
+
+ The function either returns NULL on failure (invalid parameters, truncated or
+ corrupt data or malloc failed) or a pointer to the decoded pixels. On success,
+ the qoi_desc struct is filled with the description from the file header.
+
+ The returned pixel data should be QOI_FREE()d after use. */
+void *qoi_decode(const void *data, size_t size, qoi_desc *desc, int channels);
+
+/* The two halves of qoi_decode(). qoi_decode_header() reads and validates the
+ header into desc and returns 0 if the data is not a usable QOI image.
+ qoi_decode_pixels() decodes the chunks following a header previously read by
+ qoi_decode_header() into caller-provided memory of
+ width * height * channels bytes and returns 0 on truncated or corrupt data. */
+int qoi_decode_header(const void *data, size_t size, qoi_desc *desc);
+int qoi_decode_pixels(const void *data, size_t size, const qoi_desc *desc,
+                      int channels, unsigned char *pixels);
+
+/* Resumable decoder. qoi_decode_pixels() is a thin wrapper around these
+ functions; the qoi_dec_state holds everything needed to continue decoding at
+ a pixel boundary: the byte offset of the next chunk, the current pixel, the
+ number of pending run repetitions and the running index. A copy of the state
+ taken between two calls can later be used to resume decoding from there.
+
+ qoi_decode_init() sets up the state for the first pixel after the header and
+ qoi_decode_resume() decodes the next n_pixels pixels into pixels (n_pixels *
+ channels bytes). It returns 0 if the stream ends before all of them could be
+ decoded. */
+typedef struct {
+  qoi_rgba_t index[64];
+  qoi_rgba_t px;
+  size_t p;
+  int run;
+} qoi_dec_state;
+
+void qoi_decode_init(qoi_dec_state *state);
+int qoi_decode_resume(qoi_dec_state *state, const void *data, size_t size,
+                      int channels, unsigned char *pixels, size_t n_pixels);
+
+/* Streaming variant of qoi_decode_resume() for data arriving in pieces: data
+ holds the size bytes received so far and state->p is an offset into them.
+ Decoding stops in front of the first chunk which is not completely contained
+ in data (no padding is expected behind it), so the caller can append more
+ bytes and call again. Returns the number of pixels decoded, at most
+ n_pixels. */
+size_t qoi_decode_partial(qoi_dec_state *state, const void *data, size_t size,
+                          int channels, unsigned char *pixels, size_t n_pixels);
+
+/* Encode raw RGB or RGBA pixels into a QOI image in memory.
+
+ The function either returns NULL on failure (invalid parameters or malloc
+ failed) or a pointer to the encoded data on success. On success the out_len
+ is set to the size in bytes of the encoded data.
+
+ The returned qoi data should be QOI_FREE()d after use. */
+void *qoi_encode(const void *data, const qoi_desc *desc, size_t *out_len);
+
+/* Incremental encoder. qoi_encode() is a thin wrapper around these functions;
+ they allow feeding the pixels in several consecutive pieces (e.g. row bands)
+ while the running index, previous pixel and run length are carried along in
+ the qoi_enc_state.
+
+ qoi_encode_header() writes the 14 byte header, qoi_encode_pixels() encodes
+ n_pixels pixels and qoi_encode_finish() flushes a pending run and writes the
+ end marker. All of them return the number of bytes written. The caller has to
+ provide room for at most n_pixels * (channels + 1) bytes per call to
+ qoi_encode_pixels() and 1 + sizeof(qoi_padding) bytes for qoi_encode_finish(). */
+typedef struct {
+  qoi_rgba_t index[64];
+  qoi_rgba_t px_prev;
+  int run;
+} qoi_enc_state;
+
+#define qoi_encode_max_size(desc) \
+((size_t) (desc)->width * (desc)->height * ((desc)->channels + 1) + \
+QOI_HEADER_SIZE + sizeof(qoi_padding))
+
+int qoi_encode_header(const qoi_desc *desc, unsigned char *bytes);
+void qoi_encode_init(qoi_enc_state *state);
+size_t qoi_encode_pixels(qoi_enc_state *state, const unsigned char *pixels,
+                         size_t n_pixels, int channels, unsigned char *bytes);
+int qoi_encode_finish(qoi_enc_state *state, unsigned char *bytes);
+
+/* Restart points for independently encoded parts of one image.
+ qoi_encode_restart() encodes the given pixel explicitly as QOI_OP_RGB(A) and
+ resets the index so that no following chunk refers to anything before the
+ restart point: a decoder can start at the returned chunk with a fresh state,
+ while a decoder running through the whole stream gets the same pixels.
+ qoi_encode_flush() ends a part by writing a pending run, without the end
+ marker. */
+int qoi_encode_restart(qoi_enc_state *state, const unsigned char *pixel,
+                       int channels, unsigned char *bytes);
+int qoi_encode_flush(qoi_enc_state *state, unsigned char *bytes);
+
 #endif // QOI_H
@@ -1,192 +1,258 @@
 #include <R.h>
 #include <Rinternals.h>
+#include <string.h>
 
-#include <stdio.h>
 #include "qoi.h"
+#include "image.h"
+#include "mapfile.h"
+#include "seek.h"
+#include "rqoi.h"
 
-void *qoi_decode(const void *data, int size, qoi_desc *desc, int channels) {
-  if (desc == NULL) Rf_error("desc is NULL");
-  const unsigned char *bytes;
-  unsigned int header_magic;
-  unsigned char *pixels;
-  qoi_rgba_t index[64];
-  qoi_rgba_t px;
-  int px_len, chunks_len, px_pos;
-  int p = 0, run = 0;
-
-  if (
-      data == NULL || desc == NULL ||
-        (channels != 0 && channels != 3 && channels != 4) ||
-        size < QOI_HEADER_SIZE + (int)sizeof(qoi_padding)
-  ) {
-    return NULL;
-  }
-
-  bytes = (const unsigned char *)data;
-
-  header_magic = qoi_read_32(bytes, &p);
-  desc->width = qoi_read_32(bytes, &p);
-  desc->height = qoi_read_32(bytes, &p);
-  desc->channels = bytes[p++];
-  desc->colorspace = bytes[p++];
-
-  if (
-      desc->width == 0 || desc->height == 0 ||
-        desc->channels < 3 || desc->channels > 4 ||
-        desc->colorspace > 1 ||
-        header_magic != QOI_MAGIC ||
-        desc->height >= QOI_PIXELS_MAX / desc->width
-  ) {
-    return NULL;
-  }
-
-  if (channels == 0) {
-    channels = desc->channels;
-  }
-
-  px_len = desc->width * desc->height * channels;
-  pixels = (unsigned char *) QOI_MALLOC(px_len);
-  if (!pixels) {
-    return NULL;
-  }
+R_xlen_t qoi_image_length(const qoi_desc *desc, int format) {
+  R_xlen_t pixels = (R_xlen_t) desc->height * desc->width;
+  return format == QOI_FORMAT_NATIVE_RASTER ? pixels : pixels * desc->channels;
+}
 
-  QOI_ZEROARR(index);
-  px.rgba.r = 0;
-  px.rgba.g = 0;
-  px.rgba.b = 0;
-  px.rgba.a = 255;
+void qoi_image_attributes(SEXP res, const qoi_desc *desc, int format) {
+  int height = desc->height;
+  int width = desc->width;
+  int channels = desc->channels;
+  SEXP dim;
 
-  chunks_len = size - (int)sizeof(qoi_padding);
-  for (px_pos = 0; px_pos < px_len; px_pos += channels) {
-    if (run > 0) {
-      run--;
-    }
-    else if (p < chunks_len) {
-      int b1 = bytes[p++];
-
-      if (b1 == QOI_OP_RGB) {
-        px.rgba.r = bytes[p++];
-        px.rgba.g = bytes[p++];
-        px.rgba.b = bytes[p++];
-      }
-      else if (b1 == QOI_OP_RGBA) {
-        px.rgba.r = bytes[p++];
-        px.rgba.g = bytes[p++];
-        px.rgba.b = bytes[p++];
-        px.rgba.a = bytes[p++];
-      }
-      else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
-        px = index[b1];
-      }
-      else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
-        px.rgba.r += ((b1 >> 4) & 0x03) - 2;
-        px.rgba.g += ((b1 >> 2) & 0x03) - 2;
-        px.rgba.b += ( b1       & 0x03) - 2;
-      }
-      else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
-        int b2 = bytes[p++];
-        int vg = (b1 & 0x3f) - 32;
-        px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
-        px.rgba.g += vg;
-        px.rgba.b += vg - 8 +  (b2       & 0x0f);
-      }
-      else if ((b1 & QOI_MASK_2) == QOI_OP_RUN) {
-        run = (b1 & 0x3f);
-      }
-
-      index[QOI_COLOR_HASH(px) % 64] = px;
-    }
+  switch (format) {
+  case QOI_FORMAT_RAW:
+    // interleaved channels x width x height: qoi_decode writes the result
+    dim = PROTECT(allocVector(INTSXP, 3));
+    INTEGER(dim)[0] = channels;
+    INTEGER(dim)[1] = width;
+    INTEGER(dim)[2] = height;
+    setAttrib(res, R_DimSymbol, dim);
+    break;
 
-    pixels[px_pos + 0] = px.rgba.r;
-    pixels[px_pos + 1] = px.rgba.g;
-    pixels[px_pos + 2] = px.rgba.b;
+  case QOI_FORMAT_NATIVE_RASTER:
+    // one packed RGBA integer per pixel, row by row (R_RGBA() byte order)
+    dim = PROTECT(allocVector(INTSXP, 2));
+    INTEGER(dim)[0] = height;
+    INTEGER(dim)[1] = width;
+    setAttrib(res, R_DimSymbol, dim);
+    setAttrib(res, R_ClassSymbol, mkString("nativeRaster"));
+    setAttrib(res, install("channels"), ScalarInteger(channels));
+    break;
 
-    if (channels == 4) {
-      pixels[px_pos + 3] = px.rgba.a;
-    }
+  default:
+    // see: https://github.com/hadley/r-internals/blob/master/vectors.md#get-and-set-values
+    dim = PROTECT(allocVector(INTSXP, 3));
+    INTEGER(dim)[0] = height;
+    INTEGER(dim)[1] = width;
+    INTEGER(dim)[2] = channels;
+    setAttrib(res, R_DimSymbol, dim);
+    break;
   }
+  UNPROTECT(1);
+}
 
-  return pixels;
+SEXP qoi_alloc_image(const qoi_desc *desc, int format) {
+  SEXP res = PROTECT(allocVector(format == QOI_FORMAT_RAW ? RAWSXP : INTSXP,
+                                 qoi_image_length(desc, format)));
+  qoi_image_attributes(res, desc, format);
+  UNPROTECT(1);
+  return res;
 }
 
-SEXP qoiRead_(SEXP sFilename) {
+const unsigned char *qoi_open_input(SEXP sFilename, qoi_file_map *map,
+                                    size_t *size, qoi_desc *desc,
+                                    qoi_context *ctx) {
   const char *fn;
-  char *data;
-  unsigned char *pixels;
-  FILE *f=0;
-  qoi_desc desc;
+  const unsigned char *data;
+  size_t len;
 
   if (TYPEOF(sFilename) == RAWSXP) {
-    data = (char*) RAW(sFilename);
+    // decode straight from the raw vector, no copy needed
+    data = RAW(sFilename);
+    len = XLENGTH(sFilename);
   } else {
     if (TYPEOF(sFilename) != STRSXP || LENGTH(sFilename) < 1) Rf_error("invalid filename");
     fn = CHAR(STRING_ELT(sFilename, 0));
-    f = fopen(fn, "rb");
-    if (!f) Rf_error("unable to open %s", fn);
+    switch (ctx ? qoi_read_file_into(fn, &ctx->input, map) : qoi_map_file(fn, map)) {
+    case QOI_MAP_OK:
+      break;
+    case QOI_MAP_EEMPTY:
+      Rf_error("File has size 0");
+    case QOI_MAP_EREAD:
+      Rf_error("unable to read %s", fn);
+    default:
+      Rf_error("unable to open %s", fn);
+    }
+    data = map->data;
+    len = map->size;
   }
 
-  // read size of bin file and open it, buffer result into data
-  fseek(f, 0, SEEK_END);
-  int size = ftell(f);
-  if (size <= 0) {
-    fclose(f);
-    Rf_error("File has size 0");
+  // check header:
+  if (!qoi_decode_header(data, len, desc)) {
+    qoi_unmap_file(map);
+    Rf_error("Wrong file format!");
   }
-  fseek(f, 0, SEEK_SET);
 
-  data = QOI_MALLOC(size);
-  if (!data) {
-    fclose(f);
-    Rf_error("Malloc error!");
-  }
+  *size = len;
+  return data;
+}
+
+SEXP qoiRead_(SEXP sFilename, SEXP sFormat, SEXP sContext, SEXP sReuse, SEXP sLazy) {
+  const unsigned char *data;
+  size_t size;
+  int format = asInteger(sFormat);
+  qoi_file_map map = {NULL, 0, 0};
+  qoi_context *ctx = qoi_context_get(sContext);
+  qoi_desc desc;
 
-  int bytes_read = fread(data, 1, size, f);
-  fclose(f);
+  if (format < QOI_FORMAT_ARRAY || format > QOI_FORMAT_NATIVE_RASTER)
+    Rf_error("invalid output format");
 
-  // check header:
-  int p = 0;
-  unsigned int header_magic = qoi_read_32((const unsigned char*)data, &p);
-  if (header_magic != QOI_MAGIC) Rf_error("Wrong file format!");
+  data = qoi_open_input(sFilename, &map, &size, &desc, ctx);
 
-  // give the data to qoi_decode
-  pixels = qoi_decode(data, bytes_read, &desc, 0);
-  QOI_FREE(data);
+  // a lazy image keeps the encoded bytes: a raw vector as it is, a file as a
+  // copy of its content, which is all that is read now
+  if (asLogical(sLazy) == TRUE && qoi_lazy_available()) {
+    SEXP bytes = sFilename;
 
-  if (pixels == NULL) {
+    if (TYPEOF(bytes) != RAWSXP) {
+      bytes = allocVector(RAWSXP, (R_xlen_t) size);
+      memcpy(RAW(bytes), data, size);
+    }
+    qoi_unmap_file(&map);
+    PROTECT(bytes);
+    SEXP res = qoi_lazy_image(bytes, &desc, format);
+    UNPROTECT(1);
+    return res;
+  }
+
+  // decode directly into the result: raw and nativeRaster need no conversion,
+  // the integer array is transposed to R's planar layout
+  SEXP res = PROTECT(qoi_context_image(sContext, asLogical(sReuse) == TRUE, &desc, format));
+  int ok = qoi_decode_image_region(data, size, &desc, NULL, 0, 0, desc.width,
+                                   desc.height, format, qoi_image_data(res), ctx);
+  qoi_unmap_file(&map);
+
+  if (!ok) {
     Rf_error("Decoding went wrong!");
     return R_NilValue;
   }
 
-  // convert pixels to vector of pixels
-  int height = desc.height;
-  int width = desc.width;
-  int channels = desc.channels;
-  int n_pixels = height * width * channels;
-
-  SEXP res;
-  res = PROTECT(allocVector(INTSXP, n_pixels));
-  // see: https://github.com/hadley/r-internals/blob/master/vectors.md#get-and-set-values
-  int* px = INTEGER(res);
-
-  // convert result of qoi_decode to rgb array
-  int counter = 0;
-  for(int y = 0; y < height; y++){
-    for (int x = 0; x < width; x++){
-      for (int c = 0; c < channels; c++){
-        px[y + x * height + c * height*width] = pixels[counter];
-        counter++;
-      }
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP qoiIndex_(SEXP sFilename, SEXP sEvery) {
+  const unsigned char *data;
+  size_t size;
+  int every = asInteger(sEvery);
+  qoi_file_map map = {NULL, 0, 0};
+  qoi_desc desc;
+
+  if (every == NA_INTEGER || every < 1)
+    Rf_error("'every' must be a positive number of rows");
+
+  data = qoi_open_input(sFilename, &map, &size, &desc, NULL);
+
+  SEXP res = PROTECT(allocVector(RAWSXP, qoi_index_size(&desc, every)));
+  int ok = qoi_index_build(data, size, &desc, every, RAW(res));
+  qoi_unmap_file(&map);
+
+  if (!ok)
+    Rf_error("Decoding went wrong!");
+
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP qoiReadRegion_(SEXP sFilename, SEXP sFormat, SEXP sRegion, SEXP sIndex,
+                    SEXP sContext, SEXP sReuse) {
+  const unsigned char *data, *index = NULL;
+  size_t size;
+  int format = asInteger(sFormat);
+  qoi_file_map map = {NULL, 0, 0};
+  qoi_context *ctx = qoi_context_get(sContext);
+  qoi_desc desc, region;
+  int x0, y0, w, h;
+
+  if (format < QOI_FORMAT_ARRAY || format > QOI_FORMAT_NATIVE_RASTER)
+    Rf_error("invalid output format");
+  if (TYPEOF(sRegion) != INTSXP || LENGTH(sRegion) != 4)
+    Rf_error("invalid region");
+
+  // region: first column, first row (both 0-based), number of columns, rows
+  x0 = INTEGER(sRegion)[0];
+  y0 = INTEGER(sRegion)[1];
+  w = INTEGER(sRegion)[2];
+  h = INTEGER(sRegion)[3];
+
+  data = qoi_open_input(sFilename, &map, &size, &desc, ctx);
+  // a missing extent selects the whole axis
+  if (w == NA_INTEGER) {
+    x0 = 0;
+    w = desc.width;
+  }
+  if (h == NA_INTEGER) {
+    y0 = 0;
+    h = desc.height;
+  }
+  if (x0 < 0 || y0 < 0 || w < 1 || h < 1 ||
+      x0 > (int) desc.width - w || y0 > (int) desc.height - h) {
+    qoi_unmap_file(&map);
+    Rf_error("region exceeds the image of %u x %u pixels", desc.width, desc.height);
+  }
+
+  if (TYPEOF(sIndex) == RAWSXP) {
+    if (!qoi_index_check(RAW(sIndex), XLENGTH(sIndex), &desc, size)) {
+      qoi_unmap_file(&map);
+      Rf_error("index does not belong to this image");
     }
+    index = RAW(sIndex);
   }
 
-  // Set dimensions for export to R
-  SEXP dim;
-  dim = allocVector(INTSXP, 3);
-  INTEGER(dim)[0] = height;
-  INTEGER(dim)[1] = width;
-  INTEGER(dim)[2] = channels;
-  setAttrib(res, R_DimSymbol, dim);
+  region = desc;
+  region.width = w;
+  region.height = h;
+  SEXP res = PROTECT(qoi_context_image(sContext, asLogical(sReuse) == TRUE, &region, format));
+  int ok = qoi_decode_image_region(data, size, &desc, index, x0, y0, w, h,
+                                   format, qoi_image_data(res), ctx);
+  qoi_unmap_file(&map);
+
+  if (!ok)
+    Rf_error("Decoding went wrong!");
+
   UNPROTECT(1);
+  return res;
+}
 
+SEXP qoiReadScaled_(SEXP sFilename, SEXP sFormat, SEXP sScale, SEXP sContext,
+                    SEXP sReuse) {
+  const unsigned char *data;
+  size_t size;
+  int format = asInteger(sFormat);
+  int scale = asInteger(sScale);
+  qoi_file_map map = {NULL, 0, 0};
+  qoi_context *ctx = qoi_context_get(sContext);
+  qoi_desc desc, scaled;
+
+  if (format < QOI_FORMAT_ARRAY || format > QOI_FORMAT_NATIVE_RASTER)
+    Rf_error("invalid output format");
+  if (scale == NA_INTEGER || scale < 1 || scale > QOI_SCALE_MAX)
+    Rf_error("'scale' must be a whole number from 1 to %d", QOI_SCALE_MAX);
+
+  data = qoi_open_input(sFilename, &map, &size, &desc, ctx);
+
+  // only the scaled image is allocated, the rows are reduced as they come
+  scaled = desc;
+  scaled.width = (desc.width + scale - 1) / scale;
+  scaled.height = (desc.height + scale - 1) / scale;
+  SEXP res = PROTECT(qoi_context_image(sContext, asLogical(sReuse) == TRUE, &scaled, format));
+  int ok = qoi_decode_image_scaled(data, size, &desc, scale, format, qoi_image_data(res));
+  qoi_unmap_file(&map);
+
+  if (!ok)
+    Rf_error("Decoding went wrong!");
+
+  UNPROTECT(1);
   return res;
 }
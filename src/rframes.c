@@ -0,0 +1,121 @@
+#include <R.h>
+#include <Rinternals.h>
+
+#include "qoi.h"
+#include "frames.h"
+#include "image.h"
+#include "rqoi.h"
+
+/* R interface to the multi-frame container, see frames.h */
+
+/* The frame table of the input of readQOIFrame(), which stays mapped */
+static const unsigned char *qoi_open_frames(SEXP sInput, qoi_file_map *map,
+                                            size_t *size, qoi_frames *frames) {
+  const unsigned char *data;
+  qoi_desc desc;
+
+  // the header of the first frame is checked by qoi_open_input()
+  data = qoi_open_input(sInput, map, size, &desc, NULL);
+  if (!qoi_frames_open(data, *size, frames)) {
+    qoi_unmap_file(map);
+    Rf_error("invalid frame table");
+  }
+  return data;
+}
+
+SEXP qoiFrameCount_(SEXP sInput) {
+  qoi_file_map map = {NULL, 0, 0};
+  qoi_frames frames;
+  size_t size;
+
+  qoi_open_frames(sInput, &map, &size, &frames);
+  qoi_unmap_file(&map);
+  return ScalarReal((double) frames.count);
+}
+
+SEXP qoiReadFrame_(SEXP sInput, SEXP sFrame, SEXP sFormat, SEXP sContext, SEXP sReuse) {
+  const unsigned char *data;
+  qoi_file_map map = {NULL, 0, 0};
+  qoi_frames frames;
+  qoi_desc desc;
+  size_t size;
+  double frame = asReal(sFrame);
+  int format = asInteger(sFormat);
+
+  if (format < QOI_FORMAT_ARRAY || format > QOI_FORMAT_NATIVE_RASTER)
+    Rf_error("invalid output format");
+  if (ISNAN(frame) || frame < 1)
+    Rf_error("'frame' must be a positive number");
+  // the context only keeps the result, the file is mapped all the same
+  qoi_context_get(sContext);
+
+  data = qoi_open_frames(sInput, &map, &size, &frames);
+  if (frame > frames.count) {
+    qoi_unmap_file(&map);
+    Rf_error("there are only %u frames", frames.count);
+  }
+
+  // only the pages of this frame (and those it is a delta of) are touched in
+  // a mapped file
+  if (!qoi_frames_desc(data, &frames, (unsigned int) frame - 1, &desc)) {
+    qoi_unmap_file(&map);
+    Rf_error("frame %.0f is corrupt", frame);
+  }
+
+  SEXP res = PROTECT(qoi_context_image(sContext, asLogical(sReuse) == TRUE, &desc, format));
+  int ok = qoi_frames_decode(data, &frames, (unsigned int) frame - 1, &desc, format,
+                             qoi_image_data(res));
+  qoi_unmap_file(&map);
+
+  if (!ok)
+    Rf_error("Decoding went wrong!");
+
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP qoiWriteFrames_(SEXP sImages, SEXP sPath, SEXP sAppend, SEXP sKeyframe) {
+  qoi_frames_writer w;
+  const char *fn;
+  R_xlen_t n;
+  qoi_desc *desc;
+  const void **data;
+  int *input, status, keyframe = asInteger(sKeyframe);
+
+  if (TYPEOF(sImages) != VECSXP) Rf_error("images must be a list");
+  if (TYPEOF(sPath) != STRSXP || LENGTH(sPath) < 1) Rf_error("invalid filename");
+  if (keyframe == NA_INTEGER || keyframe < 1) Rf_error("'keyframe' must be a positive number");
+  fn = CHAR(STRING_ELT(sPath, 0));
+
+  // every image is checked before the file is touched, and its data pointer
+  // taken: that decodes lazy images, which may fail with an R error, and no
+  // error must leave the file half written
+  n = XLENGTH(sImages);
+  desc = (qoi_desc *) R_alloc(n, sizeof(qoi_desc));
+  input = (int *) R_alloc(n, sizeof(int));
+  data = (const void **) R_alloc(n, sizeof(const void *));
+  for (R_xlen_t i = 0; i < n; i++)
+    input[i] = qoi_image_desc(VECTOR_ELT(sImages, i), &desc[i]);
+  for (R_xlen_t i = 0; i < n; i++)
+    data[i] = qoi_image_data(VECTOR_ELT(sImages, i));
+
+  status = qoi_frames_begin(&w, fn, asLogical(sAppend) == TRUE,
+                            (unsigned int) keyframe);
+  for (R_xlen_t i = 0; i < n && status == QOI_FRAMES_OK; i++)
+    status = qoi_frames_add(&w, data[i], input[i], &desc[i]);
+  status = qoi_frames_end(&w);
+
+  switch (status) {
+  case QOI_FRAMES_OK:
+    break;
+  case QOI_FRAMES_EOPEN:
+    Rf_error("unable to open %s", fn);
+  case QOI_FRAMES_EFORMAT:
+    Rf_error("%s is neither a QOI image nor a frame container", fn);
+  case QOI_FRAMES_EALLOC:
+    Rf_error("Malloc error!");
+  default:
+    Rf_error("unable to write %s", fn);
+  }
+  return R_NilValue;
+}
@@ -0,0 +1,74 @@
+#ifndef QOI_RQOI_H
+#define QOI_RQOI_H
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include "qoi.h"
+#include "image.h"
+#include "mapfile.h"
+
+/* Helpers shared by the .Call entry points */
+
+/* Allocate the result of readQOI(format = ) for an image described by desc,
+ with dim (and class) already set. The result is not protected. */
+SEXP qoi_alloc_image(const qoi_desc *desc, int format);
+
+/* The two halves of qoi_alloc_image(): the length of the vector and the
+ attributes (dim and, for a native raster, class and channels) it is given */
+R_xlen_t qoi_image_length(const qoi_desc *desc, int format);
+void qoi_image_attributes(SEXP res, const qoi_desc *desc, int format);
+
+/* Lazily decoded images (see lazy.c): an ALTREP vector with the attributes
+ of qoi_alloc_image() which holds the encoded image in the raw vector bytes
+ and decodes it when its pixels are first accessed. Only available with
+ ALTREP support (R >= 3.5.0), which qoi_lazy_available() tells. */
+void qoi_lazy_init(DllInfo *dll);
+int qoi_lazy_available(void);
+SEXP qoi_lazy_image(SEXP bytes, const qoi_desc *desc, int format);
+
+/* Pointer to the pixel memory of a vector returned by qoi_alloc_image() or
+ accepted by qoi_image_desc() */
+static inline void *qoi_image_data(SEXP image) {
+  switch (TYPEOF(image)) {
+  case RAWSXP:
+    return RAW(image);
+  case REALSXP:
+    return REAL(image);
+  case LGLSXP:
+    return LOGICAL(image);
+  default:
+    return INTEGER(image);
+  }
+}
+
+/* Map the input of readQOI() (a file name or a raw vector, which is used in
+ place) and read its header into desc. With a context, files are read into
+ its input buffer instead of being mapped. Raises an R error if the input
+ cannot be read or is not a QOI image; on success the caller has to
+ qoi_unmap_file(map) when done with the data. */
+const unsigned char *qoi_open_input(SEXP sFilename, qoi_file_map *map,
+                                    size_t *size, qoi_desc *desc,
+                                    qoi_context *ctx);
+
+/* The context behind an external pointer made by qoiContext(), NULL for
+ R_NilValue. Raises an R error for anything else. */
+qoi_context *qoi_context_get(SEXP ptr);
+
+/* The image a read decodes into: a new one from qoi_alloc_image() or, with
+ reuse and a context (ptr other than R_NilValue), the image the context kept
+ from its last such read if it has the type and dimensions qoi_alloc_image()
+ would give it. A new image is kept by the context in its place. The result
+ is not protected. */
+SEXP qoi_context_image(SEXP ptr, int reuse, const qoi_desc *desc, int format);
+
+/* Validate an image passed to writeQOI() and fill desc from its dimensions.
+ Raises an R error for unsupported input. Returns the input layout of the
+ image, one of QOI_INPUT_* (see image.h). */
+int qoi_image_desc(SEXP image, qoi_desc *desc);
+
+/* Number of worker threads for a thread count given from R: at least 1, at
+ most the number of processors and always 1 without OpenMP. */
+int qoi_threads(SEXP sThreads);
+
+#endif // QOI_RQOI_H
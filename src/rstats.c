@@ -0,0 +1,197 @@
+#include <R.h>
+#include <Rinternals.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qoi.h"
+#include "image.h"
+#include "stats.h"
+#include "transpose.h"
+#include "rqoi.h"
+
+static const char *op_names[QOI_STATS_OPS] = {
+  "index", "diff", "luma", "run", "rgb", "rgba"
+};
+
+static SEXP qoi_named_real(const char **names, const double *values, int n) {
+  SEXP res = PROTECT(allocVector(REALSXP, n));
+  SEXP nms = PROTECT(allocVector(STRSXP, n));
+
+  for (int i = 0; i < n; i++) {
+    REAL(res)[i] = values[i];
+    SET_STRING_ELT(nms, i, mkChar(names[i]));
+  }
+  setAttrib(res, R_NamesSymbol, nms);
+  UNPROTECT(2);
+  return res;
+}
+
+/* The result of qoiStats(): chunk counts and the timings of the phases */
+static SEXP qoi_stats_result(const qoi_stats *stats, const qoi_desc *desc,
+                             const char *mode, const char **phases,
+                             const double *timings, int n_phases) {
+  static const char *names[] = {
+    "mode", "width", "height", "channels", "ops", "bytes", "runs",
+    "index_hit_rate", "timings"
+  };
+  double ops[QOI_STATS_OPS], bytes[QOI_STATS_OPS], coded = 0;
+  SEXP res, nms, runs;
+
+  for (int i = 0; i < QOI_STATS_OPS; i++) {
+    ops[i] = (double) stats->ops[i];
+    bytes[i] = (double) stats->bytes[i];
+    if (i != QOI_STATS_RUN)
+      coded += ops[i];
+  }
+
+  res = PROTECT(allocVector(VECSXP, 9));
+  SET_VECTOR_ELT(res, 0, mkString(mode));
+  SET_VECTOR_ELT(res, 1, ScalarInteger(desc->width));
+  SET_VECTOR_ELT(res, 2, ScalarInteger(desc->height));
+  SET_VECTOR_ELT(res, 3, ScalarInteger(desc->channels));
+  SET_VECTOR_ELT(res, 4, qoi_named_real(op_names, ops, QOI_STATS_OPS));
+  SET_VECTOR_ELT(res, 5, qoi_named_real(op_names, bytes, QOI_STATS_OPS));
+
+  // RUN chunks by run length 1 .. 62
+  runs = PROTECT(allocVector(REALSXP, 62));
+  nms = PROTECT(allocVector(STRSXP, 62));
+  for (int i = 0; i < 62; i++) {
+    char label[4];
+    snprintf(label, sizeof(label), "%d", i + 1);
+    REAL(runs)[i] = (double) stats->runs[i];
+    SET_STRING_ELT(nms, i, mkChar(label));
+  }
+  setAttrib(runs, R_NamesSymbol, nms);
+  SET_VECTOR_ELT(res, 6, runs);
+  UNPROTECT(2);
+
+  // share of the pixels outside of runs which were found in the index
+  SET_VECTOR_ELT(res, 7, ScalarReal(coded > 0 ? ops[QOI_STATS_INDEX] / coded : NA_REAL));
+  SET_VECTOR_ELT(res, 8, qoi_named_real(phases, timings, n_phases));
+
+  nms = PROTECT(allocVector(STRSXP, 9));
+  for (int i = 0; i < 9; i++)
+    SET_STRING_ELT(nms, i, mkChar(names[i]));
+  setAttrib(res, R_NamesSymbol, nms);
+
+  UNPROTECT(2);
+  return res;
+}
+
+/* readQOI() in separately timed steps */
+static SEXP qoi_stats_decode(SEXP sInput, int format) {
+  static const char *phases[] = {"read", "alloc", "decode", "transpose"};
+  double timings[4], t = qoi_clock();
+  const unsigned char *data;
+  unsigned char *pixels;
+  volatile unsigned char touch = 0;
+  qoi_file_map map = {NULL, 0, 0};
+  qoi_stats stats;
+  qoi_desc desc;
+  size_t size;
+  int channels, ok;
+  SEXP image, res;
+
+  data = qoi_open_input(sInput, &map, &size, &desc, NULL);
+  // fault in the mapped pages here, so that reading the file is not counted
+  // as decoding
+  for (size_t i = 0; i < size; i += 4096)
+    touch ^= data[i];
+  timings[0] = qoi_clock() - t;
+
+  t = qoi_clock();
+  image = PROTECT(qoi_alloc_image(&desc, format));
+  timings[1] = qoi_clock() - t;
+
+  channels = format == QOI_FORMAT_NATIVE_RASTER ? 4 : desc.channels;
+  if (format == QOI_FORMAT_ARRAY) {
+    pixels = (unsigned char *) malloc((size_t) desc.width * desc.height * channels);
+    if (!pixels) {
+      qoi_unmap_file(&map);
+      Rf_error("Malloc error!");
+    }
+  } else {
+    pixels = (unsigned char *) qoi_image_data(image);
+  }
+
+  t = qoi_clock();
+  ok = qoi_decode_pixels(data, size, &desc, channels, pixels);
+  timings[2] = qoi_clock() - t;
+
+  t = qoi_clock();
+  if (ok && format == QOI_FORMAT_ARRAY) {
+    qoi_planar_from_interleaved(pixels, INTEGER(image), desc.width, desc.height,
+                                channels, 0, desc.height);
+  } else if (ok && format == QOI_FORMAT_NATIVE_RASTER) {
+    qoi_native_raster_order((unsigned int *) pixels, (size_t) desc.width * desc.height);
+  }
+  timings[3] = qoi_clock() - t;
+
+  if (format == QOI_FORMAT_ARRAY)
+    free(pixels);
+  ok = ok && qoi_stats_chunks(data, size, &desc, &stats);
+  qoi_unmap_file(&map);
+
+  if (!ok)
+    Rf_error("Decoding went wrong!");
+
+  res = qoi_stats_result(&stats, &desc, "decode", phases, timings, 4);
+  UNPROTECT(1);
+  return res;
+}
+
+/* writeQOI(image) to a raw vector in separately timed steps */
+static SEXP qoi_stats_encode(SEXP image) {
+  static const char *phases[] = {"transpose", "encode", "alloc"};
+  double timings[3], t;
+  const unsigned char *pixels;
+  unsigned char *scratch = NULL, *bytes;
+  qoi_stats stats;
+  qoi_desc desc;
+  int input = qoi_image_desc(image, &desc);
+  size_t len;
+  SEXP encoded;
+
+  t = qoi_clock();
+  if (input != QOI_INPUT_RAW) {
+    scratch = (unsigned char *) malloc((size_t) desc.width * desc.height * desc.channels);
+    if (!scratch)
+      Rf_error("Malloc error!");
+    qoi_interleave_rows(qoi_image_data(image), input, &desc, scratch, 0, desc.height, NULL);
+    pixels = scratch;
+  } else {
+    pixels = RAW(image);
+  }
+  timings[0] = qoi_clock() - t;
+
+  t = qoi_clock();
+  bytes = (unsigned char *) qoi_encode(pixels, &desc, &len);
+  timings[1] = qoi_clock() - t;
+  free(scratch);
+  if (!bytes)
+    Rf_error("Malloc error!");
+
+  t = qoi_clock();
+  encoded = allocVector(RAWSXP, (R_xlen_t) len);
+  memcpy(RAW(encoded), bytes, len);
+  timings[2] = qoi_clock() - t;
+  QOI_FREE(bytes);
+
+  PROTECT(encoded);
+  qoi_stats_chunks(RAW(encoded), len, &desc, &stats);
+  SEXP res = qoi_stats_result(&stats, &desc, "encode", phases, timings, 3);
+  UNPROTECT(1);
+  return res;
+}
+
+SEXP qoiStats_(SEXP sInput, SEXP sEncode, SEXP sFormat) {
+  int format = asInteger(sFormat);
+
+  if (asLogical(sEncode))
+    return qoi_stats_encode(sInput);
+
+  if (format < QOI_FORMAT_ARRAY || format > QOI_FORMAT_NATIVE_RASTER)
+    Rf_error("invalid output format");
+  return qoi_stats_decode(sInput, format);
+}
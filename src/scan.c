@@ -0,0 +1,166 @@
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define QOI_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* Classify pixels i0 .. n - 1, one at a time */
+static void qoi_scan_tail(const qoi_rgba_t *block, int i0, int n, qoi_scan_t *scan) {
+  for (int i = i0; i < n; i++) {
+    qoi_rgba_t px = block[i + 1], prev = block[i];
+    signed char vr = px.rgba.r - prev.rgba.r;
+    signed char vg = px.rgba.g - prev.rgba.g;
+    signed char vb = px.rgba.b - prev.rgba.b;
+    signed char vg_r = vr - vg;
+    signed char vg_b = vb - vg;
+    uint64_t bit = (uint64_t) 1 << i;
+
+    if (px.v == prev.v)
+      scan->eq |= bit;
+    if (px.rgba.a != prev.rgba.a)
+      continue;
+
+    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+      scan->diff |= bit;
+      scan->code[i] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+    }
+    else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+      scan->luma |= bit;
+      scan->code[i] = (QOI_OP_LUMA | (vg + 32)) | ((vg_r + 8) << 4 | (vg_b + 8)) << 8;
+    }
+  }
+}
+
+static void qoi_scan_scalar(const qoi_rgba_t *block, int n, qoi_scan_t *scan) {
+  scan->eq = scan->diff = scan->luma = 0;
+  qoi_scan_tail(block, 0, n, scan);
+}
+
+#ifdef QOI_X86_SIMD
+
+/* The vector kernels treat a pixel as a 32-bit lane with red in the lowest
+ byte (x86 is little-endian). With d = px - prev bytewise:
+
+   DIFF  iff d + {2, 2, 2, 0} is {0..3, 0..3, 0..3, 0}
+   LUMA  iff d - {vg, 0, vg, 0} + {8, 32, 8, 0} is {0..15, 0..63, 0..15, 0}
+
+ where the byte additions wrap like the signed char arithmetic of the scalar
+ encoder. Both codes are computed for every lane and the DIFF code is kept
+ where it applies. */
+#define QOI_DIFF_BIAS  0x00020202
+#define QOI_DIFF_MASK  0xfffcfcfcu
+#define QOI_LUMA_BIAS  0x00082008
+#define QOI_LUMA_MASK  0xfff0c0f0u
+
+static void qoi_scan_sse2(const qoi_rgba_t *block, int n, qoi_scan_t *scan) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i lo = _mm_set1_epi32(0xff);
+  uint64_t eq = 0, diff = 0, luma = 0;
+  int i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128i cur = _mm_loadu_si128((const __m128i *) (block + i + 1));
+    __m128i prev = _mm_loadu_si128((const __m128i *) (block + i));
+    __m128i d = _mm_sub_epi8(cur, prev);
+    __m128i t = _mm_add_epi8(d, _mm_set1_epi32(QOI_DIFF_BIAS));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(d, 8), lo);
+    __m128i u = _mm_add_epi8(_mm_sub_epi8(d, _mm_or_si128(g, _mm_slli_epi32(g, 16))),
+                             _mm_set1_epi32(QOI_LUMA_BIAS));
+    __m128i is_diff = _mm_cmpeq_epi32(_mm_and_si128(t, _mm_set1_epi32((int) QOI_DIFF_MASK)), zero);
+    __m128i is_luma = _mm_cmpeq_epi32(_mm_and_si128(u, _mm_set1_epi32((int) QOI_LUMA_MASK)), zero);
+
+    // 0x40 | r << 4 | g << 2 | b of the biased differences
+    __m128i diff_code = _mm_or_si128(
+      _mm_or_si128(_mm_slli_epi32(_mm_and_si128(t, lo), 4),
+                   _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(t, 8), lo), 2)),
+      _mm_or_si128(_mm_and_si128(_mm_srli_epi32(t, 16), lo), _mm_set1_epi32(QOI_OP_DIFF)));
+    // 0x80 | g, then r << 4 | b
+    __m128i luma_code = _mm_or_si128(
+      _mm_or_si128(_mm_and_si128(_mm_srli_epi32(u, 8), lo), _mm_set1_epi32(QOI_OP_LUMA)),
+      _mm_slli_epi32(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(u, lo), 4),
+                                  _mm_and_si128(_mm_srli_epi32(u, 16), lo)), 8));
+
+    _mm_storeu_si128((__m128i *) (scan->code + i),
+                     _mm_or_si128(_mm_and_si128(is_diff, diff_code),
+                                  _mm_andnot_si128(is_diff, luma_code)));
+    eq |= (uint64_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(cur, prev))) << i;
+    diff |= (uint64_t) _mm_movemask_ps(_mm_castsi128_ps(is_diff)) << i;
+    luma |= (uint64_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(is_diff, is_luma))) << i;
+  }
+
+  scan->eq = eq;
+  scan->diff = diff;
+  scan->luma = luma;
+  qoi_scan_tail(block, i, n, scan);
+}
+
+#define QOI_AVX2 __attribute__((target("avx2")))
+
+QOI_AVX2 static void qoi_scan_avx2(const qoi_rgba_t *block, int n, qoi_scan_t *scan) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i lo = _mm256_set1_epi32(0xff);
+  uint64_t eq = 0, diff = 0, luma = 0;
+  int i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m256i cur = _mm256_loadu_si256((const __m256i *) (block + i + 1));
+    __m256i prev = _mm256_loadu_si256((const __m256i *) (block + i));
+    __m256i d = _mm256_sub_epi8(cur, prev);
+    __m256i t = _mm256_add_epi8(d, _mm256_set1_epi32(QOI_DIFF_BIAS));
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(d, 8), lo);
+    __m256i u = _mm256_add_epi8(_mm256_sub_epi8(d, _mm256_or_si256(g, _mm256_slli_epi32(g, 16))),
+                                _mm256_set1_epi32(QOI_LUMA_BIAS));
+    __m256i is_diff = _mm256_cmpeq_epi32(_mm256_and_si256(t, _mm256_set1_epi32((int) QOI_DIFF_MASK)), zero);
+    __m256i is_luma = _mm256_cmpeq_epi32(_mm256_and_si256(u, _mm256_set1_epi32((int) QOI_LUMA_MASK)), zero);
+
+    __m256i diff_code = _mm256_or_si256(
+      _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(t, lo), 4),
+                      _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(t, 8), lo), 2)),
+      _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(t, 16), lo), _mm256_set1_epi32(QOI_OP_DIFF)));
+    __m256i luma_code = _mm256_or_si256(
+      _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(u, 8), lo), _mm256_set1_epi32(QOI_OP_LUMA)),
+      _mm256_slli_epi32(_mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(u, lo), 4),
+                                        _mm256_and_si256(_mm256_srli_epi32(u, 16), lo)), 8));
+
+    _mm256_storeu_si256((__m256i *) (scan->code + i),
+                        _mm256_blendv_epi8(luma_code, diff_code, is_diff));
+    eq |= (uint64_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(cur, prev))) << i;
+    diff |= (uint64_t) _mm256_movemask_ps(_mm256_castsi256_ps(is_diff)) << i;
+    luma |= (uint64_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(is_diff, is_luma))) << i;
+  }
+
+  scan->eq = eq;
+  scan->diff = diff;
+  scan->luma = luma;
+  qoi_scan_tail(block, i, n, scan);
+}
+
+#endif // QOI_X86_SIMD
+
+/* -----------------------------------------------------------------------------
+ Dispatch */
+
+static void (*scan_impl)(const qoi_rgba_t *, int, qoi_scan_t *) = qoi_scan_scalar;
+static const char *kernel_name = "scalar";
+
+void qoi_scan_init(void) {
+#ifdef QOI_X86_SIMD
+  scan_impl = qoi_scan_sse2;
+  kernel_name = "sse2";
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    scan_impl = qoi_scan_avx2;
+    kernel_name = "avx2";
+  }
+#endif
+}
+
+const char *qoi_scan_kernel(void) {
+  return kernel_name;
+}
+
+void qoi_scan(const qoi_rgba_t *block, int n, qoi_scan_t *scan) {
+  scan_impl(block, n, scan);
+}
@@ -0,0 +1,36 @@
+#ifndef QOI_SCAN_H
+#define QOI_SCAN_H
+
+#include <stdint.h>
+#include "qoi.h"
+
+/* Pre-pass of the encoder over a block of up to QOI_SCAN_BLOCK pixels. For
+ pixel i (block[i + 1], compared to its predecessor block[i]) it sets
+
+   bit i of eq    if both are equal (the pixel extends a run)
+   bit i of diff  if it can be stored as a DIFF chunk
+   bit i of luma  if it can be stored as a LUMA chunk
+
+ and code[i] to the chunk bytes of DIFF (1 byte) or, failing that, LUMA (2
+ bytes, first byte lowest). Whether a pixel is found in the running index is
+ left to the encoder, which has to check that first.
+
+ The work is done 4 (SSE2) or 8 (AVX2) pixels at a time, picked at runtime by
+ qoi_scan_init() like the transpose kernels (see transpose.h); without it the
+ portable scalar kernel is used. */
+
+#define QOI_SCAN_BLOCK 64
+
+typedef struct {
+  uint64_t eq;
+  uint64_t diff;
+  uint64_t luma;
+  uint32_t code[QOI_SCAN_BLOCK];
+} qoi_scan_t;
+
+void qoi_scan_init(void);
+const char *qoi_scan_kernel(void);
+
+void qoi_scan(const qoi_rgba_t *block, int n, qoi_scan_t *scan);
+
+#endif // QOI_SCAN_H
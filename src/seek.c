@@ -0,0 +1,185 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "seek.h"
+
+static void put_u32(unsigned char *bytes, uint32_t v) {
+  bytes[0] = v >> 24;
+  bytes[1] = v >> 16;
+  bytes[2] = v >> 8;
+  bytes[3] = v;
+}
+
+static uint32_t get_u32(const unsigned char *bytes) {
+  return (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 |
+    (uint32_t) bytes[2] << 8 | bytes[3];
+}
+
+static void put_u64(unsigned char *bytes, uint64_t v) {
+  put_u32(bytes, (uint32_t) (v >> 32));
+  put_u32(bytes + 4, (uint32_t) v);
+}
+
+static uint64_t get_u64(const unsigned char *bytes) {
+  return (uint64_t) get_u32(bytes) << 32 | get_u32(bytes + 4);
+}
+
+static void put_state(unsigned char *entry, const qoi_dec_state *state) {
+  put_u64(entry, (uint64_t) state->p);
+  memcpy(entry + 8, &state->px.rgba, 4);
+  put_u32(entry + 12, (uint32_t) state->run);
+  for (int i = 0; i < 64; i++)
+    memcpy(entry + 16 + 4 * i, &state->index[i].rgba, 4);
+}
+
+/* Load checkpoint k. Returns 0 if it does not describe a position inside the
+ chunks of a stream of size bytes. */
+static int get_state(const unsigned char *index, int k, size_t size,
+                     qoi_dec_state *state) {
+  const unsigned char *entry = index + QOI_INDEX_HEADER_SIZE +
+    (size_t) k * QOI_INDEX_ENTRY_SIZE;
+  uint64_t p = get_u64(entry);
+  uint32_t run = get_u32(entry + 12);
+
+  if (size < QOI_HEADER_SIZE + sizeof(qoi_padding) || p < QOI_HEADER_SIZE ||
+      p > (uint64_t) (size - sizeof(qoi_padding)) || run > 61)
+    return 0;
+
+  state->p = (size_t) p;
+  state->run = (int) run;
+  memcpy(&state->px.rgba, entry + 8, 4);
+  for (int i = 0; i < 64; i++)
+    memcpy(&state->index[i].rgba, entry + 16 + 4 * i, 4);
+  return 1;
+}
+
+size_t qoi_index_size(const qoi_desc *desc, int every) {
+  size_t count = (desc->height + (size_t) every - 1) / every;
+  return QOI_INDEX_HEADER_SIZE + count * QOI_INDEX_ENTRY_SIZE;
+}
+
+int qoi_index_build(const void *data, size_t size, const qoi_desc *desc, int every,
+                    unsigned char *out) {
+  int width = desc->width, height = desc->height;
+  unsigned int count = (height + every - 1) / every;
+  unsigned char *row, *entry = out + QOI_INDEX_HEADER_SIZE;
+  qoi_dec_state state;
+  int ok = 1;
+
+  memcpy(out, QOI_INDEX_MAGIC, 4);
+  put_u32(out + 4, QOI_INDEX_VERSION);
+  put_u32(out + 8, (uint32_t) every);
+  put_u32(out + 12, count);
+  put_u32(out + 16, (uint32_t) width);
+  put_u32(out + 20, (uint32_t) height);
+  put_u64(out + 24, (uint64_t) size);
+
+  // the pixels themselves are not needed, one row is decoded at a time
+  row = (unsigned char *) QOI_MALLOC((size_t) width * 4);
+  if (!row)
+    return 0;
+
+  qoi_decode_init(&state);
+  for (int y = 0; y < height && ok; y++) {
+    if (y % every == 0) {
+      put_state(entry, &state);
+      entry += QOI_INDEX_ENTRY_SIZE;
+    }
+    ok = qoi_decode_resume(&state, data, size, 4, row, width);
+  }
+
+  QOI_FREE(row);
+  return ok;
+}
+
+int qoi_index_check(const unsigned char *index, size_t len, const qoi_desc *desc,
+                    size_t size) {
+  uint32_t every, count;
+
+  if (len < QOI_INDEX_HEADER_SIZE || memcmp(index, QOI_INDEX_MAGIC, 4) != 0 ||
+      get_u32(index + 4) != QOI_INDEX_VERSION)
+    return 0;
+
+  every = get_u32(index + 8);
+  count = get_u32(index + 12);
+  return every > 0 && every <= INT_MAX &&
+    count == (desc->height + (uint64_t) every - 1) / every &&
+    len == QOI_INDEX_HEADER_SIZE + (size_t) count * QOI_INDEX_ENTRY_SIZE &&
+    get_u32(index + 16) == desc->width &&
+    get_u32(index + 20) == desc->height &&
+    get_u64(index + 24) == (uint64_t) size;
+}
+
+int qoi_decode_seek(const void *data, size_t size, const qoi_desc *desc,
+                    const unsigned char *index, int y0, unsigned char *row,
+                    qoi_dec_state *state) {
+  int width = desc->width;
+  unsigned char *own = NULL;
+  int y = 0, ok = 1;
+
+  if (index) {
+    int every = (int) get_u32(index + 8);
+    if (!get_state(index, y0 / every, size, state))
+      return 0;
+    y = y0 / every * every;
+  } else {
+    qoi_decode_init(state);
+  }
+  if (y == y0)
+    return 1;
+
+  if (!row) {
+    row = own = (unsigned char *) QOI_MALLOC((size_t) width * 4);
+    if (!row)
+      return 0;
+  }
+
+  // rows between the checkpoint and y0 are decoded and dropped
+  for (; y < y0 && ok; y++)
+    ok = qoi_decode_resume(state, data, size, 4, row, width);
+
+  if (own)
+    QOI_FREE(own);
+  return ok;
+}
+
+int qoi_decode_rows(qoi_dec_state *state, const void *data, size_t size,
+                    const qoi_desc *desc, int x0, int w, int h, int channels,
+                    unsigned char *row, unsigned char *out) {
+  int width = desc->width;
+  size_t stride = (size_t) w * channels;
+  int ok = 1;
+
+  if (w == width)
+    return qoi_decode_resume(state, data, size, channels, out, (size_t) h * width);
+
+  for (int i = 0; i < h && ok; i++) {
+    ok = qoi_decode_resume(state, data, size, channels, row, width);
+    memcpy(out + i * stride, row + (size_t) x0 * channels, stride);
+  }
+  return ok;
+}
+
+int qoi_decode_region(const void *data, size_t size, const qoi_desc *desc,
+                      const unsigned char *index, int x0, int y0, int w, int h,
+                      int channels, unsigned char *out) {
+  unsigned char *row = NULL;
+  qoi_dec_state state;
+  int ok;
+
+  if (!qoi_decode_seek(data, size, desc, index, y0, NULL, &state))
+    return 0;
+
+  if (w < (int) desc->width) {
+    row = (unsigned char *) QOI_MALLOC((size_t) desc->width * channels);
+    if (!row)
+      return 0;
+  }
+
+  ok = qoi_decode_rows(&state, data, size, desc, x0, w, h, channels, row, out);
+
+  if (row)
+    QOI_FREE(row);
+  return ok;
+}
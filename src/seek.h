@@ -0,0 +1,72 @@
+#ifndef QOI_SEEK_H
+#define QOI_SEEK_H
+
+#include <stddef.h>
+#include "qoi.h"
+
+/* Row checkpoint index for random access into a QOI stream. Every `every`
+ rows the complete decoder state (see qoi_dec_state) is recorded, so decoding
+ a band of rows can start at the closest checkpoint above it instead of at
+ the first pixel. Layout, all numbers big-endian:
+
+   u8  magic[4]        QOI_INDEX_MAGIC
+   u32 version
+   u32 every           rows between two checkpoints
+   u32 count           number of checkpoints, checkpoint k is at row k * every
+   u32 width, height   of the indexed image
+   u64 size            of the indexed QOI data in bytes
+
+ followed by count entries of QOI_INDEX_ENTRY_SIZE bytes:
+
+   u64 p               offset of the next chunk
+   u8  px[4]           current pixel, RGBA
+   u32 run             pending run repetitions
+   u8  index[64][4]    running index, RGBA
+
+ The index does not depend on the byte order of the machine and can be stored
+ next to the image. */
+
+#define QOI_INDEX_MAGIC "qidx"
+#define QOI_INDEX_VERSION 1
+#define QOI_INDEX_HEADER_SIZE 32
+#define QOI_INDEX_ENTRY_SIZE (8 + 4 + 4 + 64 * 4)
+
+size_t qoi_index_size(const qoi_desc *desc, int every);
+
+/* Decode the image once and write its index to out, which must have room for
+ qoi_index_size(desc, every) bytes. Returns 0 on corrupt data or if the row
+ buffer could not be allocated. */
+int qoi_index_build(const void *data, size_t size, const qoi_desc *desc, int every,
+                    unsigned char *out);
+
+/* Returns 1 if index is a well-formed index of len bytes for the image of
+ size bytes described by desc. */
+int qoi_index_check(const unsigned char *index, size_t len, const qoi_desc *desc,
+                    size_t size);
+
+/* Decode the region of w x h pixels starting at column x0 and row y0 into out
+ (w * h * channels bytes, interleaved). Decoding starts at the checkpoint
+ closest to y0 when an index (checked by qoi_index_check()) is given and at
+ the first pixel otherwise. Returns 0 on corrupt data or if the row buffer
+ could not be allocated. */
+int qoi_decode_region(const void *data, size_t size, const qoi_desc *desc,
+                      const unsigned char *index, int x0, int y0, int w, int h,
+                      int channels, unsigned char *out);
+
+/* The two steps of qoi_decode_region(), for callers decoding a region in
+ bands: qoi_decode_seek() sets up state for decoding row y0 and
+ qoi_decode_rows() continues with the next h rows, keeping the w pixels from
+ column x0 on. row is scratch space for one full row: 4 bytes per pixel for
+ qoi_decode_seek(), which allocates it itself if row is NULL, and channels
+ bytes per pixel for qoi_decode_rows(), where it may be NULL if w is the
+ image width. Both return 0 on corrupt data, qoi_decode_seek() also if its
+ row buffer could not be allocated. */
+int qoi_decode_seek(const void *data, size_t size, const qoi_desc *desc,
+                    const unsigned char *index, int y0, unsigned char *row,
+                    qoi_dec_state *state);
+
+int qoi_decode_rows(qoi_dec_state *state, const void *data, size_t size,
+                    const qoi_desc *desc, int x0, int w, int h, int channels,
+                    unsigned char *row, unsigned char *out);
+
+#endif // QOI_SEEK_H
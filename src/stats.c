@@ -0,0 +1,64 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include <string.h>
+#include "stats.h"
+
+int qoi_stats_chunks(const void *data, size_t size, const qoi_desc *desc,
+                     qoi_stats *stats) {
+  const unsigned char *bytes = (const unsigned char *) data;
+  uint64_t total = (uint64_t) desc->width * desc->height;
+  size_t p = QOI_HEADER_SIZE;
+  size_t chunks_len = size > sizeof(qoi_padding) ? size - sizeof(qoi_padding) : 0;
+
+  memset(stats, 0, sizeof(*stats));
+
+  while (stats->pixels < total && p < chunks_len) {
+    int b1 = bytes[p], op;
+    size_t len = 1;
+
+    if (b1 == QOI_OP_RGB) {
+      op = QOI_STATS_RGB;
+      len = 4;
+    } else if (b1 == QOI_OP_RGBA) {
+      op = QOI_STATS_RGBA;
+      len = 5;
+    } else {
+      switch (b1 & QOI_MASK_2) {
+      case QOI_OP_INDEX: op = QOI_STATS_INDEX; break;
+      case QOI_OP_DIFF:  op = QOI_STATS_DIFF; break;
+      case QOI_OP_LUMA:  op = QOI_STATS_LUMA; len = 2; break;
+      default:           op = QOI_STATS_RUN; break;
+      }
+    }
+    if (p + len > chunks_len)
+      return 0;
+
+    stats->ops[op]++;
+    stats->bytes[op] += len;
+    if (op == QOI_STATS_RUN) {
+      stats->runs[b1 & 0x3f]++;
+      stats->pixels += (b1 & 0x3f) + 1;
+    } else {
+      stats->pixels++;
+    }
+    p += len;
+  }
+
+  return stats->pixels >= total;
+}
+
+double qoi_clock(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (double) count.QuadPart / freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
@@ -0,0 +1,34 @@
+#ifndef QOI_STATS_H
+#define QOI_STATS_H
+
+#include <stdint.h>
+#include "qoi.h"
+
+/* Chunk statistics of a QOI stream, see qoiStats(). They are gathered by a
+ separate pass over the chunks, so the encoder and decoder themselves carry
+ no instrumentation at all. */
+
+#define QOI_STATS_INDEX 0
+#define QOI_STATS_DIFF  1
+#define QOI_STATS_LUMA  2
+#define QOI_STATS_RUN   3
+#define QOI_STATS_RGB   4
+#define QOI_STATS_RGBA  5
+#define QOI_STATS_OPS   6
+
+typedef struct {
+  uint64_t ops[QOI_STATS_OPS];    // chunks of each kind
+  uint64_t bytes[QOI_STATS_OPS];  // bytes taken by them
+  uint64_t runs[62];              // RUN chunks by length - 1
+  uint64_t pixels;                // pixels covered by the chunks
+} qoi_stats;
+
+/* Count the chunks of the image described by desc. Returns 0 if a chunk runs
+ into the end marker or the chunks do not cover all pixels. */
+int qoi_stats_chunks(const void *data, size_t size, const qoi_desc *desc,
+                     qoi_stats *stats);
+
+/* Monotonic wall clock in seconds for timing phases */
+double qoi_clock(void);
+
+#endif // QOI_STATS_H
@@ -0,0 +1,242 @@
+#include <R.h>
+#include <Rinternals.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qoi.h"
+#include "image.h"
+#include "transpose.h"
+#include "rqoi.h"
+
+/* number of pixels per band of interleaved rows kept for the planar array
+ format before they are moved into the result, at least 16 rows */
+#define QOI_STREAM_BAND_PIXELS 65536
+#define QOI_STREAM_BAND_MIN_ROWS 16
+
+/* State of a streaming decoder, see qoiDecoder(). The result is allocated as
+ soon as the header has arrived and is kept as the protected value of the
+ external pointer. */
+typedef struct {
+  int format;
+  int channels;          // channels decoded, 4 for nativeRaster
+  int header;            // 1 once the header has been read
+  qoi_desc desc;
+  qoi_dec_state state;   // state.p is an offset into window
+  unsigned char *window; // bytes received but not decoded yet
+  size_t window_len;
+  size_t window_cap;
+  unsigned char *band;   // interleaved rows for the planar array format
+  int band_rows;
+  size_t px_done;        // pixels decoded
+  int rows_done;         // rows stored in the result
+} qoi_stream;
+
+static void qoi_stream_release(qoi_stream *s) {
+  free(s->window);
+  free(s->band);
+  s->window = s->band = NULL;
+  s->window_len = s->window_cap = 0;
+}
+
+static void qoi_stream_finalize(SEXP ptr) {
+  qoi_stream *s = (qoi_stream *) R_ExternalPtrAddr(ptr);
+
+  if (s) {
+    qoi_stream_release(s);
+    free(s);
+    R_ClearExternalPtr(ptr);
+  }
+}
+
+static qoi_stream *qoi_stream_get(SEXP ptr) {
+  qoi_stream *s;
+
+  if (TYPEOF(ptr) != EXTPTRSXP || R_ExternalPtrTag(ptr) != install("qoi_decoder") ||
+      !(s = (qoi_stream *) R_ExternalPtrAddr(ptr)))
+    Rf_error("invalid decoder");
+  return s;
+}
+
+/* Copy the rows y0 .. y0 + rows - 1 of a result of qoi_alloc_image() into a
+ new image of the same format, with the row numbers as attribute "rows" */
+static SEXP qoi_copy_rows(SEXP image, const qoi_desc *desc, int format,
+                          int y0, int rows) {
+  int width = desc->width, height = desc->height, channels = desc->channels;
+  qoi_desc band = *desc;
+  SEXP res, idx;
+
+  band.height = rows;
+  res = PROTECT(qoi_alloc_image(&band, format));
+
+  switch (format) {
+  case QOI_FORMAT_RAW:
+    memcpy(RAW(res), RAW(image) + (size_t) y0 * width * channels,
+           (size_t) rows * width * channels);
+    break;
+
+  case QOI_FORMAT_NATIVE_RASTER:
+    memcpy(INTEGER(res), INTEGER(image) + (size_t) y0 * width,
+           (size_t) rows * width * sizeof(int));
+    break;
+
+  default:
+    for (size_t j = 0; j < (size_t) width * channels; j++)
+      memcpy(INTEGER(res) + j * rows, INTEGER(image) + j * height + y0,
+             rows * sizeof(int));
+    break;
+  }
+
+  idx = PROTECT(allocVector(INTSXP, rows));
+  for (int i = 0; i < rows; i++)
+    INTEGER(idx)[i] = y0 + i + 1;
+  setAttrib(res, install("rows"), idx);
+
+  UNPROTECT(2);
+  return res;
+}
+
+SEXP qoiDecoder_(SEXP sFormat) {
+  int format = asInteger(sFormat);
+  qoi_stream *s;
+  SEXP ptr;
+
+  if (format < QOI_FORMAT_ARRAY || format > QOI_FORMAT_NATIVE_RASTER)
+    Rf_error("invalid output format");
+
+  s = (qoi_stream *) calloc(1, sizeof(qoi_stream));
+  if (!s)
+    Rf_error("unable to allocate the decoder");
+  s->format = format;
+
+  ptr = PROTECT(R_MakeExternalPtr(s, install("qoi_decoder"), R_NilValue));
+  R_RegisterCFinalizerEx(ptr, qoi_stream_finalize, TRUE);
+  UNPROTECT(1);
+  return ptr;
+}
+
+/* sRows: return the completed rows; readQOI() only needs the whole image and
+ spares the copies */
+SEXP qoiDecoderPush_(SEXP ptr, SEXP sBytes, SEXP sRows) {
+  qoi_stream *s = qoi_stream_get(ptr);
+  int width, y0;
+  size_t total, n_bytes;
+  SEXP image;
+  void *out;
+
+  if (TYPEOF(sBytes) != RAWSXP)
+    Rf_error("'bytes' must be a raw vector");
+  if ((uint64_t) XLENGTH(sBytes) > SIZE_MAX - s->window_len)
+    Rf_error("too many bytes at once");
+  n_bytes = (size_t) XLENGTH(sBytes);
+
+  // anything behind the last pixel is the end marker
+  if (n_bytes == 0 ||
+      (s->header && s->px_done == (size_t) s->desc.width * s->desc.height))
+    return R_NilValue;
+
+  if (s->window_len + n_bytes > s->window_cap) {
+    unsigned char *window = (unsigned char *) realloc(s->window, s->window_len + n_bytes);
+    if (!window)
+      Rf_error("unable to allocate the input window");
+    s->window = window;
+    s->window_cap = s->window_len + n_bytes;
+  }
+  memcpy(s->window + s->window_len, RAW(sBytes), n_bytes);
+  s->window_len += n_bytes;
+
+  if (!s->header) {
+    if (s->window_len < QOI_HEADER_SIZE)
+      return R_NilValue;
+
+    // qoi_decode_header() reads the 14 header bytes only, the size just has to
+    // admit the shortest possible stream
+    if (!qoi_decode_header(s->window, QOI_HEADER_SIZE + sizeof(qoi_padding), &s->desc))
+      Rf_error("Wrong file format!");
+
+    s->channels = s->format == QOI_FORMAT_NATIVE_RASTER ? 4 : s->desc.channels;
+    R_SetExternalPtrProtected(ptr, qoi_alloc_image(&s->desc, s->format));
+
+    if (s->format == QOI_FORMAT_ARRAY) {
+      s->band_rows = QOI_STREAM_BAND_PIXELS / s->desc.width;
+      if (s->band_rows < QOI_STREAM_BAND_MIN_ROWS) s->band_rows = QOI_STREAM_BAND_MIN_ROWS;
+      if (s->band_rows > (int) s->desc.height) s->band_rows = s->desc.height;
+      s->band = (unsigned char *) malloc((size_t) s->band_rows * s->desc.width * s->channels);
+      if (!s->band)
+        Rf_error("unable to allocate the row buffer");
+    }
+
+    qoi_decode_init(&s->state);
+    s->header = 1;
+  }
+
+  image = R_ExternalPtrProtected(ptr);
+  out = qoi_image_data(image);
+  width = s->desc.width;
+  total = (size_t) width * s->desc.height;
+  y0 = s->rows_done;
+
+  while (s->px_done < total) {
+    unsigned char *dst;
+    size_t n, got;
+
+    if (s->format == QOI_FORMAT_ARRAY) {
+      size_t band_pos = s->px_done - (size_t) s->rows_done * width;
+      n = (size_t) s->band_rows * width - band_pos;
+      dst = s->band + (size_t) band_pos * s->channels;
+    } else {
+      // raw and nativeRaster are decoded straight into the result
+      n = total - s->px_done;
+      dst = (unsigned char *) out + (size_t) s->px_done * s->channels;
+    }
+    if (n > total - s->px_done)
+      n = total - s->px_done;
+
+    got = qoi_decode_partial(&s->state, s->window, s->window_len, s->channels, dst, n);
+    s->px_done += got;
+
+    if (s->format == QOI_FORMAT_ARRAY) {
+      // move the complete rows into the result, keep the partial one
+      int rows = (int) (s->px_done / width) - s->rows_done;
+      if (rows > 0) {
+        size_t rest = s->px_done - (size_t) (s->rows_done + rows) * width;
+        qoi_planar_from_interleaved(s->band, (int *) out, width, s->desc.height,
+                                    s->channels, s->rows_done, rows);
+        memmove(s->band, s->band + (size_t) rows * width * s->channels,
+                (size_t) rest * s->channels);
+        s->rows_done += rows;
+      }
+    } else {
+      int rows_done = (int) (s->px_done / width);
+
+      // only complete rows, the pixels of a partial one are still decoded
+      if (s->format == QOI_FORMAT_NATIVE_RASTER)
+        qoi_native_raster_order((unsigned int *) out + (size_t) s->rows_done * width,
+                                (size_t) (rows_done - s->rows_done) * width);
+      s->rows_done = rows_done;
+    }
+
+    if (got < n)
+      break;
+  }
+
+  // keep the bytes of an incomplete chunk for the next call
+  memmove(s->window, s->window + s->state.p, s->window_len - s->state.p);
+  s->window_len -= s->state.p;
+  s->state.p = 0;
+
+  if (s->px_done == total)
+    qoi_stream_release(s);
+
+  if (s->rows_done == y0 || asLogical(sRows) != TRUE)
+    return R_NilValue;
+  return qoi_copy_rows(image, &s->desc, s->format, y0, s->rows_done - y0);
+}
+
+SEXP qoiDecoderImage_(SEXP ptr) {
+  qoi_stream *s = qoi_stream_get(ptr);
+
+  if (!s->header || s->px_done < (size_t) s->desc.width * s->desc.height)
+    return R_NilValue;
+  return R_ExternalPtrProtected(ptr);
+}
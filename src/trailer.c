@@ -0,0 +1,59 @@
+#include <string.h>
+#include "trailer.h"
+
+static void put_u32(unsigned char *bytes, uint32_t v) {
+  bytes[0] = v >> 24;
+  bytes[1] = v >> 16;
+  bytes[2] = v >> 8;
+  bytes[3] = v;
+}
+
+static uint32_t get_u32(const unsigned char *bytes) {
+  return (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 |
+    (uint32_t) bytes[2] << 8 | bytes[3];
+}
+
+size_t qoi_trailer_size(unsigned int count) {
+  return (size_t) count * 8 + QOI_TRAILER_FOOTER_SIZE;
+}
+
+size_t qoi_trailer_write(unsigned char *bytes, const char *magic,
+                         unsigned int param, const uint64_t *offsets,
+                         unsigned int count) {
+  size_t p = 0;
+
+  for (unsigned int i = 0; i < count; i++, p += 8) {
+    put_u32(bytes + p, (uint32_t) (offsets[i] >> 32));
+    put_u32(bytes + p + 4, (uint32_t) offsets[i]);
+  }
+  put_u32(bytes + p, param);
+  put_u32(bytes + p + 4, count);
+  memcpy(bytes + p + 8, magic, 4);
+
+  return p + QOI_TRAILER_FOOTER_SIZE;
+}
+
+int qoi_trailer_find(const unsigned char *data, size_t size, const char *magic,
+                     unsigned int *param, unsigned int *count,
+                     const unsigned char **table) {
+  const unsigned char *footer;
+  unsigned int n;
+
+  if (size < QOI_TRAILER_FOOTER_SIZE) return 0;
+
+  footer = data + size - QOI_TRAILER_FOOTER_SIZE;
+  if (memcmp(footer + 8, magic, 4) != 0) return 0;
+
+  n = get_u32(footer + 4);
+  if ((size - QOI_TRAILER_FOOTER_SIZE) / 8 < n) return 0;
+
+  *param = get_u32(footer);
+  *count = n;
+  *table = footer - (size_t) n * 8;
+  return 1;
+}
+
+uint64_t qoi_trailer_offset(const unsigned char *table, unsigned int i) {
+  return (uint64_t) get_u32(table + 8 * (size_t) i) << 32 |
+    get_u32(table + 8 * (size_t) i + 4);
+}
@@ -0,0 +1,38 @@
+#ifndef QOI_TRAILER_H
+#define QOI_TRAILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Trailing offset table appended behind a QOI stream (after its end marker),
+ so the file stays readable by any QOI decoder, which stops after the last
+ pixel. Layout, all numbers big-endian:
+
+   u64 offset[count]   byte offsets into the file
+   u32 param           meaning depends on the magic
+   u32 count
+   u8  magic[4]
+
+ The table is found from the end of the file, the magic tells what the
+ offsets point at. */
+
+#define QOI_TRAILER_FOOTER_SIZE 12
+
+size_t qoi_trailer_size(unsigned int count);
+
+/* Write the trailer for count offsets to bytes, which must have room for
+ qoi_trailer_size(count) bytes. Returns the number of bytes written. */
+size_t qoi_trailer_write(unsigned char *bytes, const char *magic,
+                         unsigned int param, const uint64_t *offsets,
+                         unsigned int count);
+
+/* Look for a trailer with the given magic at the end of data. Returns 0 if
+ there is none, otherwise fills param and count and sets *table to the start
+ of the offset table, to be read with qoi_trailer_offset(). */
+int qoi_trailer_find(const unsigned char *data, size_t size, const char *magic,
+                     unsigned int *param, unsigned int *count,
+                     const unsigned char **table);
+
+uint64_t qoi_trailer_offset(const unsigned char *table, unsigned int i);
+
+#endif // QOI_TRAILER_H
@@ -0,0 +1,624 @@
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+#include "qoi.h"
+#include "transpose.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define QOI_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* A tile spans QOI_TILE_ROWS rows of QOI_TILE_COLS pixels. Per tile the
+ interleaved side touches QOI_TILE_ROWS short row segments and the planar side
+ QOI_TILE_COLS * channels runs of QOI_TILE_ROWS consecutive integers, which
+ all stay in L1 while the tile is transposed. */
+#define QOI_TILE_ROWS 64
+#define QOI_TILE_COLS 32
+
+#define QOI_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static inline unsigned char qoi_clamp_u8(int v) {
+  return v < 0 ? 0 : v > 255 ? 255 : (unsigned char) v;
+}
+
+/* x * 255 rounded and clamped to 0..255; NaN fails both comparisons */
+static inline unsigned char qoi_quantize_u8(double x) {
+  double v = x * 255.0 + 0.5;
+  v = v > 0 ? v : 0;
+  v = v < 255 ? v : 255;
+  return (unsigned char) v;
+}
+
+static inline int qoi_in_unit(double x) {
+  return x >= 0 && x <= 1;
+}
+
+/* NA_LOGICAL is INT_MIN, anything else but 0 is TRUE */
+static inline unsigned char qoi_lgl_u8(int v) {
+  return v != 0 && v != INT_MIN ? 255 : 0;
+}
+
+/* A column of ny rows starting at planar index `base` had values out of
+ range; find the first of them (by channel, then row) for the range. This
+ is the only time the values are looked at twice. */
+static void qoi_range_column(const double *s, size_t plane, int ny, int channels,
+                             size_t base, size_t bad, qoi_range *range) {
+  qoi_range col = {bad, 0};
+
+  if (!range)
+    return;
+  for (int c = 0; c < channels; c++) {
+    for (int y = 0; y < ny; y++) {
+      if (!qoi_in_unit(s[y + c * plane])) {
+        col.first = base + y + c * plane;
+        qoi_range_merge(range, &col);
+        return;
+      }
+    }
+  }
+}
+
+/* -----------------------------------------------------------------------------
+ Scalar kernels */
+
+static void planar_from_interleaved_scalar(const unsigned char *src, int *dst,
+                                           int width, int height, int channels,
+                                           int y0, int rows) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const unsigned char *s = src + ty * stride + (size_t) x * channels;
+        int *d = dst + (size_t) x * height + y0 + ty;
+        for (int y = 0; y < ny; y++, s += stride) {
+          for (int c = 0; c < channels; c++) {
+            d[y + c * plane] = s[c];
+          }
+        }
+      }
+    }
+  }
+}
+
+static void interleaved_from_planar_scalar(const int *src, unsigned char *dst,
+                                           int width, int height, int channels,
+                                           int y0, int rows) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const int *s = src + (size_t) x * height + y0 + ty;
+        unsigned char *d = dst + ty * stride + (size_t) x * channels;
+        for (int y = 0; y < ny; y++, d += stride) {
+          for (int c = 0; c < channels; c++) {
+            d[c] = qoi_clamp_u8(s[y + c * plane]);
+          }
+        }
+      }
+    }
+  }
+}
+
+static void interleaved_from_planar_real_scalar(const double *src, unsigned char *dst,
+                                                int width, int height, int channels,
+                                                int y0, int rows, qoi_range *range) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const double *s = src + (size_t) x * height + y0 + ty;
+        unsigned char *d = dst + ty * stride + (size_t) x * channels;
+        size_t bad = 0;
+        for (int y = 0; y < ny; y++, d += stride) {
+          for (int c = 0; c < channels; c++) {
+            double v = s[y + c * plane];
+            bad += !qoi_in_unit(v);
+            d[c] = qoi_quantize_u8(v);
+          }
+        }
+        if (bad)
+          qoi_range_column(s, plane, ny, channels, s - src, bad, range);
+      }
+    }
+  }
+}
+
+/* Logical images are masks at best, so there are no SIMD variants */
+static void interleaved_from_planar_lgl_scalar(const int *src, unsigned char *dst,
+                                               int width, int height, int channels,
+                                               int y0, int rows) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const int *s = src + (size_t) x * height + y0 + ty;
+        unsigned char *d = dst + ty * stride + (size_t) x * channels;
+        for (int y = 0; y < ny; y++, d += stride) {
+          for (int c = 0; c < channels; c++) {
+            d[c] = qoi_lgl_u8(s[y + c * plane]);
+          }
+        }
+      }
+    }
+  }
+}
+
+#ifdef QOI_X86_SIMD
+
+QOI_INLINE unsigned int qoi_load_px(const unsigned char *s, int channels) {
+  unsigned int v = 0;
+  memcpy(&v, s, channels);
+  return v;
+}
+
+/* -----------------------------------------------------------------------------
+ SSE2 kernels: four rows of one image column per step */
+
+/* [r0 g0 b0 a0 r1 g1 b1 a1 ...] <-> [r0 r1 r2 r3 g0 g1 g2 g3 ...] */
+QOI_INLINE __m128i qoi_transpose4x4_sse2(__m128i v) {
+  v = _mm_unpacklo_epi8(v, _mm_srli_si128(v, 8));
+  return _mm_unpacklo_epi8(v, _mm_srli_si128(v, 8));
+}
+
+QOI_INLINE void planar_col4_sse2(const unsigned char *s, size_t stride,
+                                    int *d, size_t plane, int channels) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v = _mm_set_epi32(qoi_load_px(s + 3 * stride, channels),
+                            qoi_load_px(s + 2 * stride, channels),
+                            qoi_load_px(s + stride, channels),
+                            qoi_load_px(s, channels));
+  v = qoi_transpose4x4_sse2(v);
+
+  __m128i rg = _mm_unpacklo_epi8(v, zero);
+  __m128i ba = _mm_unpackhi_epi8(v, zero);
+  _mm_storeu_si128((__m128i *) d, _mm_unpacklo_epi16(rg, zero));
+  _mm_storeu_si128((__m128i *) (d + plane), _mm_unpackhi_epi16(rg, zero));
+  _mm_storeu_si128((__m128i *) (d + 2 * plane), _mm_unpacklo_epi16(ba, zero));
+  if (channels == 4)
+    _mm_storeu_si128((__m128i *) (d + 3 * plane), _mm_unpackhi_epi16(ba, zero));
+}
+
+/* four rows of each channel as integers to four interleaved pixels */
+QOI_INLINE void qoi_store_col4_sse2(__m128i r, __m128i g, __m128i b, __m128i a,
+                                    unsigned char *d, size_t stride, int channels) {
+  unsigned int px[4];
+
+  /* the signed/unsigned saturating packs clamp to 0..255 on the way */
+  __m128i v = _mm_packus_epi16(_mm_packs_epi32(r, g), _mm_packs_epi32(b, a));
+  _mm_storeu_si128((__m128i *) px, qoi_transpose4x4_sse2(v));
+
+  memcpy(d, &px[0], channels);
+  memcpy(d + stride, &px[1], channels);
+  memcpy(d + 2 * stride, &px[2], channels);
+  memcpy(d + 3 * stride, &px[3], channels);
+}
+
+QOI_INLINE void interleaved_col4_sse2(const int *s, size_t plane,
+                                         unsigned char *d, size_t stride,
+                                         int channels) {
+  __m128i r = _mm_loadu_si128((const __m128i *) s);
+  __m128i g = _mm_loadu_si128((const __m128i *) (s + plane));
+  __m128i b = _mm_loadu_si128((const __m128i *) (s + 2 * plane));
+  __m128i a = channels == 4 ? _mm_loadu_si128((const __m128i *) (s + 3 * plane)) : r;
+
+  qoi_store_col4_sse2(r, g, b, a, d, stride, channels);
+}
+
+/* four doubles scaled, rounded and clamped to integers; the ones outside of
+ 0..1 are added to bad */
+QOI_INLINE __m128i qoi_quantize4_sse2(const double *s, size_t *bad) {
+  const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0);
+  const __m128d scale = _mm_set1_pd(255.0), half = _mm_set1_pd(0.5);
+  __m128d lo = _mm_loadu_pd(s), hi = _mm_loadu_pd(s + 2);
+  int ok = _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(lo, zero), _mm_cmple_pd(lo, one))) |
+    _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(hi, zero), _mm_cmple_pd(hi, one))) << 2;
+
+  *bad += 4 - __builtin_popcount(ok);
+  /* max() returns its second operand for NaN, so NaN becomes 0 */
+  lo = _mm_min_pd(_mm_max_pd(_mm_add_pd(_mm_mul_pd(lo, scale), half), zero), scale);
+  hi = _mm_min_pd(_mm_max_pd(_mm_add_pd(_mm_mul_pd(hi, scale), half), zero), scale);
+  return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+QOI_INLINE void interleaved_real_col4_sse2(const double *s, size_t plane,
+                                           unsigned char *d, size_t stride,
+                                           int channels, size_t *bad) {
+  __m128i r = qoi_quantize4_sse2(s, bad);
+  __m128i g = qoi_quantize4_sse2(s + plane, bad);
+  __m128i b = qoi_quantize4_sse2(s + 2 * plane, bad);
+  __m128i a = channels == 4 ? qoi_quantize4_sse2(s + 3 * plane, bad) : r;
+
+  qoi_store_col4_sse2(r, g, b, a, d, stride, channels);
+}
+
+QOI_INLINE void planar_column_sse2(const unsigned char *s, size_t stride,
+                                 int *d, size_t plane, int ny, int channels) {
+  int y = 0;
+  for (; y + 4 <= ny; y += 4, s += 4 * stride) {
+    planar_col4_sse2(s, stride, d + y, plane, channels);
+  }
+  for (; y < ny; y++, s += stride) {
+    for (int c = 0; c < channels; c++) {
+      d[y + c * plane] = s[c];
+    }
+  }
+}
+
+static void planar_from_interleaved_sse2(const unsigned char *src, int *dst,
+                                        int width, int height, int channels,
+                                        int y0, int rows) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const unsigned char *s = src + ty * stride + (size_t) x * channels;
+        int *d = dst + (size_t) x * height + y0 + ty;
+        if (channels == 4)
+          planar_column_sse2(s, stride, d, plane, ny, 4);
+        else
+          planar_column_sse2(s, stride, d, plane, ny, 3);
+      }
+    }
+  }
+}
+
+QOI_INLINE void interleaved_column_sse2(const int *s, size_t plane,
+                                     unsigned char *d, size_t stride,
+                                     int ny, int channels) {
+  int y = 0;
+  for (; y + 4 <= ny; y += 4, d += 4 * stride) {
+    interleaved_col4_sse2(s + y, plane, d, stride, channels);
+  }
+  for (; y < ny; y++, d += stride) {
+    for (int c = 0; c < channels; c++) {
+      d[c] = qoi_clamp_u8(s[y + c * plane]);
+    }
+  }
+}
+
+static void interleaved_from_planar_sse2(const int *src, unsigned char *dst,
+                                        int width, int height, int channels,
+                                        int y0, int rows) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const int *s = src + (size_t) x * height + y0 + ty;
+        unsigned char *d = dst + ty * stride + (size_t) x * channels;
+        if (channels == 4)
+          interleaved_column_sse2(s, plane, d, stride, ny, 4);
+        else
+          interleaved_column_sse2(s, plane, d, stride, ny, 3);
+      }
+    }
+  }
+}
+
+QOI_INLINE void interleaved_real_column_sse2(const double *s, size_t plane,
+                                            unsigned char *d, size_t stride,
+                                            int ny, int channels, size_t *bad) {
+  int y = 0;
+  for (; y + 4 <= ny; y += 4, d += 4 * stride) {
+    interleaved_real_col4_sse2(s + y, plane, d, stride, channels, bad);
+  }
+  for (; y < ny; y++, d += stride) {
+    for (int c = 0; c < channels; c++) {
+      double v = s[y + c * plane];
+      *bad += !qoi_in_unit(v);
+      d[c] = qoi_quantize_u8(v);
+    }
+  }
+}
+
+static void interleaved_from_planar_real_sse2(const double *src, unsigned char *dst,
+                                              int width, int height, int channels,
+                                              int y0, int rows, qoi_range *range) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const double *s = src + (size_t) x * height + y0 + ty;
+        unsigned char *d = dst + ty * stride + (size_t) x * channels;
+        size_t bad = 0;
+        if (channels == 4)
+          interleaved_real_column_sse2(s, plane, d, stride, ny, 4, &bad);
+        else
+          interleaved_real_column_sse2(s, plane, d, stride, ny, 3, &bad);
+        if (bad)
+          qoi_range_column(s, plane, ny, channels, s - src, bad, range);
+      }
+    }
+  }
+}
+
+/* -----------------------------------------------------------------------------
+ AVX2 kernels: eight rows of one image column per step */
+
+#define QOI_AVX2 __attribute__((target("avx2")))
+
+QOI_AVX2 QOI_INLINE __m256i qoi_transpose4x4_avx2(__m256i v) {
+  const __m256i mask = _mm256_setr_epi8(
+    0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+    0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+  return _mm256_shuffle_epi8(v, mask);
+}
+
+QOI_AVX2 QOI_INLINE void planar_col8_avx2(const unsigned char *s, size_t stride,
+                                             int *d, size_t plane, int channels) {
+  __m256i v = _mm256_setr_epi32(qoi_load_px(s, channels),
+                                qoi_load_px(s + stride, channels),
+                                qoi_load_px(s + 2 * stride, channels),
+                                qoi_load_px(s + 3 * stride, channels),
+                                qoi_load_px(s + 4 * stride, channels),
+                                qoi_load_px(s + 5 * stride, channels),
+                                qoi_load_px(s + 6 * stride, channels),
+                                qoi_load_px(s + 7 * stride, channels));
+  /* per lane [R G B A] of four pixels, then gather R0-7, G0-7, B0-7, A0-7 */
+  v = qoi_transpose4x4_avx2(v);
+  v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+
+  __m128i rg = _mm256_castsi256_si128(v);
+  __m128i ba = _mm256_extracti128_si256(v, 1);
+  _mm256_storeu_si256((__m256i *) d, _mm256_cvtepu8_epi32(rg));
+  _mm256_storeu_si256((__m256i *) (d + plane), _mm256_cvtepu8_epi32(_mm_srli_si128(rg, 8)));
+  _mm256_storeu_si256((__m256i *) (d + 2 * plane), _mm256_cvtepu8_epi32(ba));
+  if (channels == 4)
+    _mm256_storeu_si256((__m256i *) (d + 3 * plane), _mm256_cvtepu8_epi32(_mm_srli_si128(ba, 8)));
+}
+
+/* eight rows of each channel as integers to eight interleaved pixels */
+QOI_AVX2 QOI_INLINE void qoi_store_col8_avx2(__m256i r, __m256i g, __m256i b, __m256i a,
+                                             unsigned char *d, size_t stride,
+                                             int channels) {
+  unsigned int px[8];
+
+  /* per lane [r g b a] of four rows, clamped to 0..255 by the packs */
+  __m256i v = _mm256_packus_epi16(_mm256_packs_epi32(r, g), _mm256_packs_epi32(b, a));
+  _mm256_storeu_si256((__m256i *) px, qoi_transpose4x4_avx2(v));
+
+  for (int k = 0; k < 8; k++) {
+    memcpy(d + k * stride, &px[k], channels);
+  }
+}
+
+QOI_AVX2 QOI_INLINE void interleaved_col8_avx2(const int *s, size_t plane,
+                                                  unsigned char *d, size_t stride,
+                                                  int channels) {
+  __m256i r = _mm256_loadu_si256((const __m256i *) s);
+  __m256i g = _mm256_loadu_si256((const __m256i *) (s + plane));
+  __m256i b = _mm256_loadu_si256((const __m256i *) (s + 2 * plane));
+  __m256i a = channels == 4 ? _mm256_loadu_si256((const __m256i *) (s + 3 * plane)) : r;
+
+  qoi_store_col8_avx2(r, g, b, a, d, stride, channels);
+}
+
+QOI_AVX2 QOI_INLINE __m128i qoi_quantize4_avx2(const double *s, int *ok) {
+  const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+  const __m256d scale = _mm256_set1_pd(255.0), half = _mm256_set1_pd(0.5);
+  __m256d v = _mm256_loadu_pd(s);
+
+  *ok = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(v, zero, _CMP_GE_OQ),
+                                         _mm256_cmp_pd(v, one, _CMP_LE_OQ)));
+  v = _mm256_min_pd(_mm256_max_pd(_mm256_add_pd(_mm256_mul_pd(v, scale), half), zero), scale);
+  return _mm256_cvttpd_epi32(v);
+}
+
+/* eight doubles as in qoi_quantize4_sse2(), rows 0-3 in the lower lane */
+QOI_AVX2 QOI_INLINE __m256i qoi_quantize8_avx2(const double *s, size_t *bad) {
+  int ok_lo, ok_hi;
+  __m128i lo = qoi_quantize4_avx2(s, &ok_lo);
+  __m128i hi = qoi_quantize4_avx2(s + 4, &ok_hi);
+
+  *bad += 8 - __builtin_popcount(ok_lo | ok_hi << 4);
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+QOI_AVX2 QOI_INLINE void interleaved_real_col8_avx2(const double *s, size_t plane,
+                                                    unsigned char *d, size_t stride,
+                                                    int channels, size_t *bad) {
+  __m256i r = qoi_quantize8_avx2(s, bad);
+  __m256i g = qoi_quantize8_avx2(s + plane, bad);
+  __m256i b = qoi_quantize8_avx2(s + 2 * plane, bad);
+  __m256i a = channels == 4 ? qoi_quantize8_avx2(s + 3 * plane, bad) : r;
+
+  qoi_store_col8_avx2(r, g, b, a, d, stride, channels);
+}
+
+QOI_AVX2 QOI_INLINE void planar_column_avx2(const unsigned char *s, size_t stride,
+                                          int *d, size_t plane, int ny, int channels) {
+  int y = 0;
+  for (; y + 8 <= ny; y += 8, s += 8 * stride) {
+    planar_col8_avx2(s, stride, d + y, plane, channels);
+  }
+  for (; y < ny; y++, s += stride) {
+    for (int c = 0; c < channels; c++) {
+      d[y + c * plane] = s[c];
+    }
+  }
+}
+
+QOI_AVX2 static void planar_from_interleaved_avx2(const unsigned char *src, int *dst,
+                                                 int width, int height, int channels,
+                                                 int y0, int rows) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const unsigned char *s = src + ty * stride + (size_t) x * channels;
+        int *d = dst + (size_t) x * height + y0 + ty;
+        if (channels == 4)
+          planar_column_avx2(s, stride, d, plane, ny, 4);
+        else
+          planar_column_avx2(s, stride, d, plane, ny, 3);
+      }
+    }
+  }
+}
+
+QOI_AVX2 QOI_INLINE void interleaved_column_avx2(const int *s, size_t plane,
+                                              unsigned char *d, size_t stride,
+                                              int ny, int channels) {
+  int y = 0;
+  for (; y + 8 <= ny; y += 8, d += 8 * stride) {
+    interleaved_col8_avx2(s + y, plane, d, stride, channels);
+  }
+  for (; y < ny; y++, d += stride) {
+    for (int c = 0; c < channels; c++) {
+      d[c] = qoi_clamp_u8(s[y + c * plane]);
+    }
+  }
+}
+
+QOI_AVX2 static void interleaved_from_planar_avx2(const int *src, unsigned char *dst,
+                                                 int width, int height, int channels,
+                                                 int y0, int rows) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const int *s = src + (size_t) x * height + y0 + ty;
+        unsigned char *d = dst + ty * stride + (size_t) x * channels;
+        if (channels == 4)
+          interleaved_column_avx2(s, plane, d, stride, ny, 4);
+        else
+          interleaved_column_avx2(s, plane, d, stride, ny, 3);
+      }
+    }
+  }
+}
+
+QOI_AVX2 QOI_INLINE void interleaved_real_column_avx2(const double *s, size_t plane,
+                                                     unsigned char *d, size_t stride,
+                                                     int ny, int channels, size_t *bad) {
+  int y = 0;
+  for (; y + 8 <= ny; y += 8, d += 8 * stride) {
+    interleaved_real_col8_avx2(s + y, plane, d, stride, channels, bad);
+  }
+  for (; y < ny; y++, d += stride) {
+    for (int c = 0; c < channels; c++) {
+      double v = s[y + c * plane];
+      *bad += !qoi_in_unit(v);
+      d[c] = qoi_quantize_u8(v);
+    }
+  }
+}
+
+QOI_AVX2 static void interleaved_from_planar_real_avx2(const double *src, unsigned char *dst,
+                                                       int width, int height, int channels,
+                                                       int y0, int rows, qoi_range *range) {
+  size_t plane = (size_t) width * height;
+  size_t stride = (size_t) width * channels;
+
+  for (int ty = 0; ty < rows; ty += QOI_TILE_ROWS) {
+    int ny = QOI_MIN(QOI_TILE_ROWS, rows - ty);
+    for (int tx = 0; tx < width; tx += QOI_TILE_COLS) {
+      int nx = QOI_MIN(QOI_TILE_COLS, width - tx);
+      for (int x = tx; x < tx + nx; x++) {
+        const double *s = src + (size_t) x * height + y0 + ty;
+        unsigned char *d = dst + ty * stride + (size_t) x * channels;
+        size_t bad = 0;
+        if (channels == 4)
+          interleaved_real_column_avx2(s, plane, d, stride, ny, 4, &bad);
+        else
+          interleaved_real_column_avx2(s, plane, d, stride, ny, 3, &bad);
+        if (bad)
+          qoi_range_column(s, plane, ny, channels, s - src, bad, range);
+      }
+    }
+  }
+}
+
+#endif // QOI_X86_SIMD
+
+/* -----------------------------------------------------------------------------
+ Dispatch */
+
+typedef void (*planar_from_interleaved_fn)(const unsigned char *, int *, int, int, int, int, int);
+typedef void (*interleaved_from_planar_fn)(const int *, unsigned char *, int, int, int, int, int);
+typedef void (*interleaved_from_planar_real_fn)(const double *, unsigned char *, int, int, int,
+                                                int, int, qoi_range *);
+
+static planar_from_interleaved_fn planar_from_interleaved_impl = planar_from_interleaved_scalar;
+static interleaved_from_planar_fn interleaved_from_planar_impl = interleaved_from_planar_scalar;
+static interleaved_from_planar_real_fn interleaved_from_planar_real_impl =
+  interleaved_from_planar_real_scalar;
+static const char *kernel_name = "scalar";
+
+void qoi_transpose_init(void) {
+#ifdef QOI_X86_SIMD
+  planar_from_interleaved_impl = planar_from_interleaved_sse2;
+  interleaved_from_planar_impl = interleaved_from_planar_sse2;
+  interleaved_from_planar_real_impl = interleaved_from_planar_real_sse2;
+  kernel_name = "sse2";
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    planar_from_interleaved_impl = planar_from_interleaved_avx2;
+    interleaved_from_planar_impl = interleaved_from_planar_avx2;
+    interleaved_from_planar_real_impl = interleaved_from_planar_real_avx2;
+    kernel_name = "avx2";
+  }
+#endif
+}
+
+const char *qoi_transpose_kernel(void) {
+  return kernel_name;
+}
+
+void qoi_planar_from_interleaved(const unsigned char *src, int *dst, int width,
+                                 int height, int channels, int y0, int rows) {
+  planar_from_interleaved_impl(src, dst, width, height, channels, y0, rows);
+}
+
+void qoi_interleaved_from_planar(const int *src, unsigned char *dst, int width,
+                                 int height, int channels, int y0, int rows) {
+  interleaved_from_planar_impl(src, dst, width, height, channels, y0, rows);
+}
+
+void qoi_interleaved_from_planar_real(const double *src, unsigned char *dst,
+                                      int width, int height, int channels,
+                                      int y0, int rows, qoi_range *range) {
+  interleaved_from_planar_real_impl(src, dst, width, height, channels, y0, rows, range);
+}
+
+void qoi_interleaved_from_planar_lgl(const int *src, unsigned char *dst, int width,
+                                     int height, int channels, int y0, int rows) {
+  interleaved_from_planar_lgl_scalar(src, dst, width, height, channels, y0, rows);
+}
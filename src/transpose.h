@@ -0,0 +1,54 @@
+#ifndef QOI_TRANSPOSE_H
+#define QOI_TRANSPOSE_H
+
+#include <stddef.h>
+
+/* Conversion between the interleaved RGB(A) byte stream of the codec
+ (row by row, pixel by pixel, channel by channel) and R's planar integer
+ arrays (height x width x channels, column-major).
+
+ Both directions work on a band of `rows` image rows starting at row `y0`: the
+ interleaved side points at the first pixel of the band, the planar side
+ always at the complete height x width x channels array. Values outside of
+ 0..255 are clamped when narrowing to bytes. Planar doubles (0..1) and
+ logicals are narrowed by their own kernels below.
+
+ The work is done in cache-sized tiles; on x86 SSE2 and AVX2 kernels are
+ picked at runtime by qoi_transpose_init(), which has to be called once
+ before any worker threads are started. Without it the portable scalar
+ kernels are used. */
+
+void qoi_transpose_init(void);
+const char *qoi_transpose_kernel(void);
+
+void qoi_planar_from_interleaved(const unsigned char *src, int *dst, int width,
+                                 int height, int channels, int y0, int rows);
+void qoi_interleaved_from_planar(const int *src, unsigned char *dst, int width,
+                                 int height, int channels, int y0, int rows);
+
+/* Values of a double image which were outside of 0..1 (or NaN) and clamped:
+ how many and the smallest index of one of them in the planar array. One
+ range is kept across the bands of an image, starting from all zeros. */
+typedef struct {
+  size_t count;
+  size_t first;
+} qoi_range;
+
+static inline void qoi_range_merge(qoi_range *range, const qoi_range *other) {
+  if (other->count && (!range->count || other->first < range->first))
+    range->first = other->first;
+  range->count += other->count;
+}
+
+/* Doubles in 0..1 are scaled to 0..255 and rounded in the same pass; values
+ outside are clamped (NaN, and so NA, becomes 0) and counted into range
+ unless it is NULL. */
+void qoi_interleaved_from_planar_real(const double *src, unsigned char *dst,
+                                      int width, int height, int channels,
+                                      int y0, int rows, qoi_range *range);
+
+/* Logicals become 255 for TRUE and 0 for FALSE and NA */
+void qoi_interleaved_from_planar_lgl(const int *src, unsigned char *dst, int width,
+                                     int height, int channels, int y0, int rows);
+
+#endif // QOI_TRANSPOSE_H
@@ -2,159 +2,32 @@
 #include <Rinternals.h>
 
 #include <stdio.h>
+#include <string.h>
 #include "qoi.h"
+#include "image.h"
+#include "rqoi.h"
 
-void *qoi_encode(const void *data, const qoi_desc *desc, int *out_len) {
-  int i, max_size, p, run;
-  int px_len, px_end, px_pos, channels;
-  unsigned char *bytes;
-  const unsigned char *pixels;
-  qoi_rgba_t index[64];
-  qoi_rgba_t px, px_prev;
-
-  if (
-      data == NULL || out_len == NULL || desc == NULL ||
-        desc->width == 0 || desc->height == 0 ||
-        desc->channels < 3 || desc->channels > 4 ||
-        desc->colorspace > 1 ||
-        desc->height >= QOI_PIXELS_MAX / desc->width
-  ) {
-    return NULL;
-  }
-
-  max_size =
-    desc->width * desc->height * (desc->channels + 1) +
-    QOI_HEADER_SIZE + sizeof(qoi_padding);
-
-  p = 0;
-  bytes = (unsigned char *) QOI_MALLOC(max_size);
-  if (!bytes) {
-    return NULL;
-  }
-
-  qoi_write_32(bytes, &p, QOI_MAGIC);
-  qoi_write_32(bytes, &p, desc->width);
-  qoi_write_32(bytes, &p, desc->height);
-  bytes[p++] = desc->channels;
-  bytes[p++] = desc->colorspace;
-
-
-  pixels = (const unsigned char *)data;
-
-  QOI_ZEROARR(index);
-
-  run = 0;
-  px_prev.rgba.r = 0;
-  px_prev.rgba.g = 0;
-  px_prev.rgba.b = 0;
-  px_prev.rgba.a = 255;
-  px = px_prev;
-
-  px_len = desc->width * desc->height * desc->channels;
-  px_end = px_len - desc->channels;
-  channels = desc->channels;
-
-  for (px_pos = 0; px_pos < px_len; px_pos += channels) {
-    px.rgba.r = pixels[px_pos + 0];
-    px.rgba.g = pixels[px_pos + 1];
-    px.rgba.b = pixels[px_pos + 2];
-
-    if (channels == 4) {
-      px.rgba.a = pixels[px_pos + 3];
-    }
-
-    if (px.v == px_prev.v) {
-      run++;
-      if (run == 62 || px_pos == px_end) {
-        bytes[p++] = QOI_OP_RUN | (run - 1);
-        run = 0;
-      }
-    }
-    else {
-      int index_pos;
-
-      if (run > 0) {
-        bytes[p++] = QOI_OP_RUN | (run - 1);
-        run = 0;
-      }
-
-      index_pos = QOI_COLOR_HASH(px) % 64;
-
-      if (index[index_pos].v == px.v) {
-        bytes[p++] = QOI_OP_INDEX | index_pos;
-      }
-      else {
-        index[index_pos] = px;
-
-        if (px.rgba.a == px_prev.rgba.a) {
-          signed char vr = px.rgba.r - px_prev.rgba.r;
-          signed char vg = px.rgba.g - px_prev.rgba.g;
-          signed char vb = px.rgba.b - px_prev.rgba.b;
-
-          signed char vg_r = vr - vg;
-          signed char vg_b = vb - vg;
-
-          if (
-              vr > -3 && vr < 2 &&
-              vg > -3 && vg < 2 &&
-              vb > -3 && vb < 2
-          ) {
-            bytes[p++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
-          }
-          else if (
-              vg_r >  -9 && vg_r <  8 &&
-              vg   > -33 && vg   < 32 &&
-              vg_b >  -9 && vg_b <  8
-          ) {
-            bytes[p++] = QOI_OP_LUMA     | (vg   + 32);
-            bytes[p++] = (vg_r + 8) << 4 | (vg_b +  8);
-          }
-          else {
-            bytes[p++] = QOI_OP_RGB;
-            bytes[p++] = px.rgba.r;
-            bytes[p++] = px.rgba.g;
-            bytes[p++] = px.rgba.b;
-          }
-        }
-        else {
-          bytes[p++] = QOI_OP_RGBA;
-          bytes[p++] = px.rgba.r;
-          bytes[p++] = px.rgba.g;
-          bytes[p++] = px.rgba.b;
-          bytes[p++] = px.rgba.a;
-        }
-      }
-    }
-    px_prev = px;
-  }
-
-  for (i = 0; i < (int)sizeof(qoi_padding); i++) {
-    bytes[p++] = qoi_padding[i];
-  }
-
-  *out_len = p;
-  return bytes;
-}
-
-SEXP qoiWrite_(SEXP image, SEXP sFilename){
+int qoi_image_desc(SEXP image, qoi_desc *desc) {
   SEXP dims;
-  SEXP res = R_NilValue;
-  const char *fn;
-  int channels = 1, raw_array = 0, width, height;
-  FILE *f=0;
+  int channels = 1, raw_array = 0, width, height, input;
 
   // check type of image-input
-  if (TYPEOF(image) == RAWSXP) raw_array = 1;
-  if (!raw_array && TYPEOF(image) != INTSXP)
-    Rf_error("image must be a matrix or array of raw or integer numbers");
-
-  if (TYPEOF(sFilename) == RAWSXP) {
-    f = 0;
-  } else {
-    if (TYPEOF(sFilename) != STRSXP || LENGTH(sFilename) < 1) Rf_error("invalid filename");
-    fn = CHAR(STRING_ELT(sFilename, 0));
-    f = fopen(fn, "wb");
-    if (!f) Rf_error("unable to create %s", fn);
+  switch (TYPEOF(image)) {
+  case RAWSXP:
+    raw_array = 1;
+    input = QOI_INPUT_RAW;
+    break;
+  case INTSXP:
+    input = QOI_INPUT_INTEGER;
+    break;
+  case REALSXP:
+    input = QOI_INPUT_REAL;
+    break;
+  case LGLSXP:
+    input = QOI_INPUT_LOGICAL;
+    break;
+  default:
+    Rf_error("image must be a matrix or array of raw, integer, double or logical values");
   }
 
   dims = Rf_getAttrib(image, R_DimSymbol);
@@ -172,59 +45,176 @@ SEXP qoiWrite_(SEXP image, SEXP sFilename){
       channels = INTEGER(dims)[2];
   }
 
-  int DataSize = width * height * channels;
-
   if (channels < 3 || channels > 4)
     Rf_error("image must have either 3 (RGB) or 4 (RGBA) channels");
 
-  // prepare incoming matrix as RGB(A) stream:
-  // see: https://github.com/hadley/r-internals/blob/master/vectors.md#get-and-set-values
-  int* dataPtr = INTEGER(image);
+  // write desc from dimensions of incoming array
+  desc->channels = channels;
+  desc->height = height;
+  desc->width = width;
+  desc->colorspace = 1;
 
-  unsigned char rgb_values[DataSize];
+  if (width <= 0 || height <= 0 || !qoi_desc_valid(desc))
+    Rf_error("image dimensions are not supported by the QOI format");
 
-  // convert result of qoi_decode to rgb array
-  int counter = 0;
-  for(int y = 0; y < height; y++){
-    for (int x = 0; x < width; x++){
-      for (int c = 0; c < channels; c++){
-        rgb_values[counter] = dataPtr[y + x * height + c * height*width];
-        counter++;
-      }
-    }
-  }
+  return input;
+}
 
-  // write desc from dimensions of incoming array
-  qoi_desc desc;
-  desc.channels = channels;
-  desc.height = height;
-  desc.width = width;
-  desc.colorspace = 1;
+/* Sinks for qoi_encode_image_stream() */
+static int qoi_write_file(void *ctx, const unsigned char *bytes, size_t len) {
+  return fwrite(bytes, 1, len, (FILE *) ctx) == len;
+}
+
+// an R function taking a raw vector, e.g. function(bytes) writeBin(bytes, con)
+static int qoi_write_function(void *ctx, const unsigned char *bytes, size_t len) {
+  SEXP chunk = PROTECT(allocVector(RAWSXP, len));
+  int error;
 
-  int size;
-  void* encoded;
+  memcpy(RAW(chunk), bytes, len);
+  R_tryEval(PROTECT(lang2((SEXP) ctx, chunk)), R_GlobalEnv, &error);
+  UNPROTECT(2);
+  return !error;
+}
+
+// the blocks for a raw() target, released by R at the end of the .Call
+typedef struct qoi_block {
+  struct qoi_block *next;
+  size_t len;
+  unsigned char bytes[];
+} qoi_block;
+
+typedef struct {
+  qoi_block *head;
+  qoi_block *tail;
+  size_t total;
+} qoi_block_list;
+
+static int qoi_write_blocks(void *ctx, const unsigned char *bytes, size_t len) {
+  qoi_block_list *list = (qoi_block_list *) ctx;
+  qoi_block *block = (qoi_block *) R_alloc(sizeof(qoi_block) + len, 1);
+
+  memcpy(block->bytes, bytes, len);
+  block->len = len;
+  block->next = NULL;
+  if (list->tail)
+    list->tail->next = block;
+  else
+    list->head = block;
+  list->tail = block;
+  list->total += len;
+  return 1;
+}
 
-  encoded = qoi_encode(&rgb_values, &desc, &size);
+/* Warn about the values of a double image which were clamped */
+static void qoi_range_warning(const qoi_range *range, const qoi_desc *desc) {
+  size_t plane = (size_t) desc->width * desc->height;
 
-  if (!encoded) {
-    fclose(f);
-    return R_NilValue;
+  if (!range->count)
+    return;
+  Rf_warning("%.0f values outside of [0, 1] were clamped, the first is image[%d, %d, %d]",
+             (double) range->count, (int) (range->first % desc->height) + 1,
+             (int) (range->first % plane / desc->height) + 1, (int) (range->first / plane) + 1);
+}
+
+SEXP qoiWrite_(SEXP image, SEXP sTarget, SEXP sStripes, SEXP sThreads, SEXP sContext,
+               SEXP sCheck){
+  SEXP res = R_NilValue;
+  const char *fn = NULL;
+  FILE *f = NULL;
+  qoi_desc desc;
+  qoi_block_list list = {NULL, NULL, 0};
+  qoi_write_fn write;
+  void *ctx;
+  int ret;
+
+  int input = qoi_image_desc(image, &desc);
+  int stripes = asInteger(sStripes);
+  qoi_range range = {0, 0}, *check = asLogical(sCheck) == TRUE ? &range : NULL;
+  int threads = qoi_threads(sThreads);
+  qoi_context *context = qoi_context_get(sContext);
+
+  if (stripes == NA_INTEGER || stripes < 1)
+    Rf_error("stripes must be a positive number");
+
+  if (context && stripes == 1 && TYPEOF(sTarget) == RAWSXP) {
+    // the encoded image is copied once from the output buffer of the context
+    size_t size = qoi_encode_image_ctx(qoi_image_data(image), input, &desc, check, context);
+    if (!size)
+      Rf_error("Malloc error!");
+    res = PROTECT(allocVector(RAWSXP, (R_xlen_t) size));
+    memcpy(RAW(res), context->output.bytes, size);
+    // the warning may allocate
+    qoi_range_warning(&range, &desc);
+    UNPROTECT(1);
+    return res;
   }
 
-  if (f) { /* if it is a file, just return */
-    fwrite(encoded, 1, size, f);
-    fclose(f);
-    return R_NilValue;
+  if (TYPEOF(sTarget) == RAWSXP) {
+    write = qoi_write_blocks;
+    ctx = &list;
+  } else if (isFunction(sTarget)) {
+    write = qoi_write_function;
+    ctx = sTarget;
+  } else {
+    if (TYPEOF(sTarget) != STRSXP || LENGTH(sTarget) < 1) Rf_error("invalid filename");
+    fn = CHAR(STRING_ELT(sTarget, 0));
+    f = fopen(fn, "wb");
+    if (!f) Rf_error("unable to create %s", fn);
+    write = qoi_write_file;
+    ctx = f;
+  }
+
+  if (stripes > 1 || context) {
+    // the stripes are encoded in parallel into one buffer, a context encodes
+    // into its output buffer; either is passed on in blocks like the output
+    // of the streaming encoder
+    size_t size = 0;
+    unsigned char *encoded;
+
+    if (stripes > 1) {
+      encoded = (unsigned char *) qoi_encode_image_striped(
+        qoi_image_data(image), input, &desc, check, stripes, threads, &size);
+    } else {
+      size = qoi_encode_image_ctx(qoi_image_data(image), input, &desc, check, context);
+      encoded = size ? context->output.bytes : NULL;
+    }
+
+    ret = encoded ? QOI_STREAM_OK : QOI_STREAM_EALLOC;
+    for (size_t p = 0; encoded && p < size && ret == QOI_STREAM_OK; p += QOI_BLOCK_SIZE) {
+      size_t len = size - p < QOI_BLOCK_SIZE ? size - p : QOI_BLOCK_SIZE;
+      if (!write(ctx, encoded + p, len))
+        ret = QOI_STREAM_EWRITE;
+    }
+    if (encoded && stripes > 1)
+      QOI_FREE(encoded);
+  } else {
+    ret = qoi_encode_image_stream(qoi_image_data(image), input, &desc, check, write, ctx);
   }
 
-  // copy encoded data into SEXP res
-  res = PROTECT(allocVector(RAWSXP, size));
-  unsigned char *byte = RAW(res);
-  for (int i=0; i<size; i++){
-    byte[i] = ((unsigned char*) encoded)[i];
+  if (f && fclose(f) != 0 && ret == QOI_STREAM_OK)
+    ret = QOI_STREAM_EWRITE;
+
+  switch (ret) {
+  case QOI_STREAM_OK:
+    break;
+  case QOI_STREAM_EALLOC:
+    Rf_error("Malloc error!");
+  default:
+    if (fn)
+      Rf_error("unable to write %s", fn);
+    Rf_error("writing the encoded image failed");
   }
+  qoi_range_warning(&range, &desc);
 
-  UNPROTECT(1);
-  QOI_FREE(encoded);
+  if (f || isFunction(sTarget)) /* if it is a file or connection, just return */
+    return R_NilValue;
+
+  // gather the blocks into a result of the exact size
+  res = allocVector(RAWSXP, list.total);
+  size_t p = 0;
+  for (qoi_block *block = list.head; block; block = block->next) {
+    memcpy(RAW(res) + p, block->bytes, block->len);
+    p += block->len;
+  }
   return res;
 }